@@ -352,6 +352,8 @@ class CrayRender(bpy.types.RenderEngine):
 		self.cr_renderer.prefs.tile_y = depsgraph.scene.c_ray.tile_size
 		self.cr_renderer.prefs.bounces = depsgraph.scene.c_ray.bounces
 		self.cr_renderer.prefs.node_list = depsgraph.scene.c_ray.node_list
+		# Final renders are worth a slower BVH build
+		self.cr_renderer.prefs.bvh_builder = 0
 		self.cr_renderer.callbacks.on_start = (on_start, None)
 		self.cr_renderer.callbacks.on_stop = (on_stop, None)
 		self.cr_renderer.callbacks.on_status_update = (on_status_update, (self.cr_renderer, self.update_progress, self.update_stats, self.test_break))
@@ -424,6 +426,8 @@ class CrayRender(bpy.types.RenderEngine):
 		self.cr_renderer.prefs.bounces = depsgraph.scene.c_ray.bounces
 		self.cr_renderer.prefs.node_list = depsgraph.scene.c_ray.node_list
 		self.cr_renderer.prefs.is_iterative = 1
+		# Edits in the viewport rebuild BVHs, so build them fast
+		self.cr_renderer.prefs.bvh_builder = 1
 		cr_cam = self.cr_scene.cameras['Camera']
 		mtx = context.region_data.view_matrix.inverted()
 		euler = mtx.to_euler('XYZ')
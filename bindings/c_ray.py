@@ -47,6 +47,15 @@ class _cr_rparam(IntEnum):
 	output_filetype = 14
 	node_list = 15
 	blender_mode = 16
+	spatial_splits = 17
+	bvh_precision = 18
+	bvh_cache_path = 19
+	bvh_builder = 20
+	flatten_scene = 21
+	noise_threshold = 22
+	pin_threads = 23
+	integrator = 24
+	sampler = 25
 
 def _r_set_num(ptr, param, value):
 	return _lib.renderer_set_num_pref(ptr, param, value)
@@ -107,7 +116,7 @@ class _pref:
 		return _r_get_num(self.r_ptr, _cr_rparam.threads)
 	def _set_threads(self, value):
 		_r_set_num(self.r_ptr, _cr_rparam.threads, value)
-	threads = property(_get_threads, _set_threads, None, "Local thread count, defaults to nproc + 2")
+	threads = property(_get_threads, _set_threads, None, "Local thread count, defaults to the number of physical cores")
 
 	def _get_samples(self):
 		return _r_get_num(self.r_ptr, _cr_rparam.samples)
@@ -210,6 +219,51 @@ class _pref:
 	def _set_blender_mode(self, value):
 		_r_set_num(self.r_ptr, _cr_rparam.blender_mode, value)
 	blender_mode = property(_get_blender_mode, _set_blender_mode, None, "")
+	def _get_spatial_splits(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.spatial_splits)
+	def _set_spatial_splits(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.spatial_splits, value)
+	spatial_splits = property(_get_spatial_splits, _set_spatial_splits, None, "")
+	def _get_bvh_precision(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.bvh_precision)
+	def _set_bvh_precision(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.bvh_precision, value)
+	bvh_precision = property(_get_bvh_precision, _set_bvh_precision, None, "")
+	def _get_bvh_cache_path(self):
+		return _r_get_str(self.r_ptr, _cr_rparam.bvh_cache_path)
+	def _set_bvh_cache_path(self, value):
+		_r_set_str(self.r_ptr, _cr_rparam.bvh_cache_path, value)
+	bvh_cache_path = property(_get_bvh_cache_path, _set_bvh_cache_path, None, "")
+	def _get_bvh_builder(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.bvh_builder)
+	def _set_bvh_builder(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.bvh_builder, value)
+	bvh_builder = property(_get_bvh_builder, _set_bvh_builder, None, "")
+	def _get_flatten_scene(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.flatten_scene)
+	def _set_flatten_scene(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.flatten_scene, value)
+	flatten_scene = property(_get_flatten_scene, _set_flatten_scene, None, "")
+	def _get_noise_threshold(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.noise_threshold) / 10000.0
+	def _set_noise_threshold(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.noise_threshold, round(value * 10000))
+	noise_threshold = property(_get_noise_threshold, _set_noise_threshold, None, "")
+	def _get_pin_threads(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.pin_threads)
+	def _set_pin_threads(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.pin_threads, value)
+	pin_threads = property(_get_pin_threads, _set_pin_threads, None, "")
+	def _get_integrator(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.integrator)
+	def _set_integrator(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.integrator, value)
+	integrator = property(_get_integrator, _set_integrator, None, "")
+	def _get_sampler(self):
+		return _r_get_num(self.r_ptr, _cr_rparam.sampler)
+	def _set_sampler(self, value):
+		_r_set_num(self.r_ptr, _cr_rparam.sampler, value)
+	sampler = property(_get_sampler, _set_sampler, None, "")
 
 class _version:
 	def _get_semantic(self):
@@ -243,6 +297,8 @@ class mesh:
 		_lib.mesh_bind_vertex_buf(self.scene_ptr, self.cr_idx, buf.cr_idx)
 	def bind_faces(self, faces, face_count):
 		_lib.mesh_bind_faces(self.scene_ptr, self.cr_idx, faces, face_count)
+	def set_spatial_split_budget(self, budget):
+		return _lib.mesh_set_spatial_split_budget(self.scene_ptr, self.cr_idx, budget)
 	def instance_new(self):
 		self.instances.append(instance(self.scene_ptr, self, 0))
 		return self.instances[-1]
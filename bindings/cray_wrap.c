@@ -187,7 +187,7 @@ static PyObject *py_cr_renderer_get_num_pref(PyObject *self, PyObject *args) {
 	if (!PyArg_ParseTuple(args, "OI", &r_ext, &p)) {
 		return NULL;
 	}
-	if (p > cr_renderer_is_iterative) {
+	if ((p > cr_renderer_is_iterative && p < cr_renderer_blender_mode) || p == cr_renderer_bvh_cache_path) {
 		PyErr_SetString(PyExc_ValueError, "cr_renderer_param not a number type");
 		return NULL;
 	}
@@ -402,6 +402,18 @@ static PyObject *py_cr_mesh_bind_faces(PyObject *self, PyObject *args) {
 	Py_RETURN_NONE;
 }
 
+static PyObject *py_cr_mesh_set_spatial_split_budget(PyObject *self, PyObject *args) {
+	(void)self; (void)args;
+	PyObject *s_ext;
+	cr_mesh mesh;
+	float budget;
+	if (!PyArg_ParseTuple(args, "Olf", &s_ext, &mesh, &budget)) {
+		return NULL;
+	}
+	struct cr_scene *s = PyCapsule_GetPointer(s_ext, "cray.cr_scene");
+	return PyBool_FromLong(cr_mesh_set_spatial_split_budget(s, mesh, budget));
+}
+
 static PyObject *py_cr_scene_mesh_new(PyObject *self, PyObject *args) {
 	(void)self; (void)args;
 	PyObject *s_ext;
@@ -693,6 +705,7 @@ static PyMethodDef cray_methods[] = {
 	{ "scene_vertex_buf_new", py_cr_scene_vertex_buf_new, METH_VARARGS, "" },
 	{ "mesh_bind_vertex_buf", py_cr_mesh_bind_vertex_buf, METH_VARARGS, "" },
 	{ "mesh_bind_faces", py_cr_mesh_bind_faces, METH_VARARGS, "" },
+	{ "mesh_set_spatial_split_budget", py_cr_mesh_set_spatial_split_budget, METH_VARARGS, "" },
 	{ "scene_mesh_new", py_cr_scene_mesh_new, METH_VARARGS, "" },
 	{ "scene_get_mesh", py_cr_scene_get_mesh, METH_VARARGS, "" },
 	{ "camera_new", py_cr_camera_new, METH_VARARGS, "" },
@@ -63,6 +63,15 @@ enum cr_renderer_param {
 	cr_renderer_output_filetype,
 	cr_renderer_node_list,
 	cr_renderer_blender_mode,
+	cr_renderer_spatial_splits, // Num, build spatial split BVHs for all meshes
+	cr_renderer_bvh_precision, // Num, bits per mesh BVH node bound: 32 (default), or 16/8 to save memory
+	cr_renderer_bvh_cache_path, // String, directory to cache mesh BVHs in between runs, unset to disable
+	cr_renderer_bvh_builder, // Num, 0 for the SAH builder (default), 1 for the fast builder, which trades traversal speed for build speed
+	cr_renderer_flatten_scene, // Num, merge mesh instances without a transform into one mesh before rendering, off by default
+	cr_renderer_noise_threshold, // Num, in 1/10000ths. Pixels stop getting samples once their noise estimate is below this, 0 (default) to always take all samples. The samples they save go to the noisier pixels of the same tile
+	cr_renderer_pin_threads, // Num, pin each render thread to its own CPU, spread over physical cores and NUMA nodes. Off by default
+	cr_renderer_integrator, // Num, 0 for the path-at-a-time integrator (default), 1 for the wavefront one, which shades batches of paths sorted by shader
+	cr_renderer_sampler, // Num, 0 for Halton (default), 1 for Hammersley, 2 for Random, 3 for Owen-scrambled Sobol
 };
 
 enum cr_tile_state {
@@ -174,6 +183,11 @@ typedef int64_t cr_object;
 
 typedef cr_object cr_sphere;
 CR_EXPORT cr_sphere cr_scene_add_sphere(struct cr_scene *s_ext, float radius);
+// Many spheres as a single object, e.g. for particles. Far cheaper to render than an instance per sphere.
+// All spheres of an instance of the set use the first material of its material set.
+// Returns -1 for an empty set.
+typedef cr_object cr_sphere_set;
+CR_EXPORT cr_sphere_set cr_scene_add_sphere_set(struct cr_scene *s_ext, const struct cr_vector *centers, const float *radii, size_t count);
 typedef cr_object cr_mesh;
 
 struct cr_vertex_buf_param {
@@ -187,6 +201,8 @@ struct cr_vertex_buf_param {
 
 typedef cr_object cr_vertex_buf;
 CR_EXPORT cr_vertex_buf cr_scene_vertex_buf_new(struct cr_scene *s_ext, struct cr_vertex_buf_param in);
+// Rebinding a buffer with the same vertex layout to a mesh that has already been rendered (e.g. for
+// vertex animation) refits its BVH, instead of rebuilding it from scratch.
 CR_EXPORT void cr_mesh_bind_vertex_buf(struct cr_scene *s_ext, cr_mesh mesh, cr_vertex_buf buf);
 
 struct cr_face {
@@ -201,6 +217,9 @@ CR_EXPORT void cr_mesh_bind_faces(struct cr_scene *s_ext, cr_mesh mesh, struct c
 
 CR_EXPORT cr_mesh cr_scene_mesh_new(struct cr_scene *s_ext, const char *name);
 CR_EXPORT cr_mesh cr_scene_get_mesh(struct cr_scene *s_ext, const char *name);
+// Use spatial splits for this mesh's BVH, allowing `budget` times more primitive references (e.g. 0.5 = 50%).
+// Slower to build, but can speed up rendering considerably for meshes with large, long or thin triangles.
+CR_EXPORT bool cr_mesh_set_spatial_split_budget(struct cr_scene *s_ext, cr_mesh mesh, float budget);
 
 // -- Camera --
 // FIXME: Use cr_vector
@@ -242,7 +261,8 @@ CR_EXPORT void cr_material_set_add(struct cr_scene *s_ext, cr_material_set set,
 typedef int64_t cr_instance;
 enum cr_object_type {
 	cr_object_mesh = 0,
-	cr_object_sphere
+	cr_object_sphere,
+	cr_object_sphere_set
 };
 
 CR_EXPORT cr_instance cr_instance_new(struct cr_scene *s_ext, cr_object object, enum cr_object_type type);
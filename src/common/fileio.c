@@ -108,6 +108,8 @@ file_data file_load(const char *file_path) {
 #ifndef WINDOWS
 	int f = open(file_path, 0);
 	void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, f, 0);
+	// The mapping stays valid after the descriptor is closed
+	if (f >= 0) close(f);
 	if (data == MAP_FAILED) {
 		logr(warning, "Couldn't mmap '%.*s': %s\n", (int)strlen(file_path), file_path, strerror(errno));
 		return (file_data){ 0 };
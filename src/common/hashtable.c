@@ -19,6 +19,8 @@
 
 #define FNV_OFFSET UINT32_C(0x811C9DC5) // Initial value for an empty hash
 #define FNV_PRIME  UINT32_C(0x01000193)
+#define FNV64_OFFSET UINT64_C(0xCBF29CE484222325)
+#define FNV64_PRIME  UINT64_C(0x00000100000001B3)
 
 // Default hash map capacity. Must be a power of two.
 #define DEFAULT_CAPACITY 8
@@ -45,6 +47,23 @@ uint32_t hashString(uint32_t h, const char *str) {
 	return h;
 }
 
+uint64_t hash64Init(void) {
+	return FNV64_OFFSET;
+}
+
+uint64_t hash64Bytes(uint64_t h, const void *bytes, size_t size) {
+	const uint8_t *b = bytes;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, b + i, sizeof(word));
+		h = (h ^ word) * FNV64_PRIME;
+	}
+	for (; i < size; ++i)
+		h = (h ^ b[i]) * FNV64_PRIME;
+	return h;
+}
+
 struct hashtable* newHashtable(bool (*compare)(const void *, const void *), struct block **pool) {
 	struct hashtable *hashtable = malloc(sizeof(struct hashtable));
 	hashtable->bucketCount = DEFAULT_CAPACITY;
@@ -36,6 +36,9 @@ uint32_t hashInit(void);
 uint32_t hashCombine(uint32_t, uint8_t);
 uint32_t hashBytes(uint32_t, const void *, size_t);
 uint32_t hashString(uint32_t, const char *);
+// 64-bit hash that consumes 8 bytes at a time, for large inputs that need few collisions
+uint64_t hash64Init(void);
+uint64_t hash64Bytes(uint64_t, const void *, size_t);
 
 struct hashtable *newHashtable(bool (*compare)(const void *, const void *), struct block **pool);
 // Finds the given element in the hash table, using the hash value `hash`.
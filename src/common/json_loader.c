@@ -80,7 +80,7 @@ void parse_prefs(struct cr_renderer *ext, const cJSON *data) {
 			cr_renderer_set_num_pref(ext, cr_renderer_threads, threads->valueint);
 			// prefs->fromSystem = false;
 		} else {
-			cr_renderer_set_num_pref(ext, cr_renderer_threads, sys_get_cores() + 2);
+			cr_renderer_set_num_pref(ext, cr_renderer_threads, sys_get_cores());
 			// prefs->fromSystem = true;
 		}
 	}
@@ -136,6 +136,72 @@ void parse_prefs(struct cr_renderer *ext, const cJSON *data) {
 		cr_renderer_set_str_pref(ext, cr_renderer_output_filetype, fileType->valuestring);
 	}
 
+	const cJSON *spatial_splits = cJSON_GetObjectItem(data, "spatialSplits");
+	if (cJSON_IsBool(spatial_splits)) {
+		cr_renderer_set_num_pref(ext, cr_renderer_spatial_splits, cJSON_IsTrue(spatial_splits));
+	}
+
+	const cJSON *bvh_precision = cJSON_GetObjectItem(data, "bvhPrecision");
+	if (cJSON_IsNumber(bvh_precision)) {
+		if (!cr_renderer_set_num_pref(ext, cr_renderer_bvh_precision, bvh_precision->valueint))
+			logr(warning, "Invalid bvhPrecision %i, expected 32, 16 or 8\n", bvh_precision->valueint);
+	}
+
+	const cJSON *bvh_builder = cJSON_GetObjectItem(data, "bvhBuilder");
+	if (cJSON_IsString(bvh_builder)) {
+		if (stringEquals(bvh_builder->valuestring, "sah"))
+			cr_renderer_set_num_pref(ext, cr_renderer_bvh_builder, 0);
+		else if (stringEquals(bvh_builder->valuestring, "fast"))
+			cr_renderer_set_num_pref(ext, cr_renderer_bvh_builder, 1);
+		else
+			logr(warning, "Invalid bvhBuilder %s, expected sah or fast\n", bvh_builder->valuestring);
+	}
+
+	const cJSON *flatten_scene = cJSON_GetObjectItem(data, "flattenScene");
+	if (cJSON_IsBool(flatten_scene)) {
+		cr_renderer_set_num_pref(ext, cr_renderer_flatten_scene, cJSON_IsTrue(flatten_scene));
+	}
+
+	const cJSON *noise_threshold = cJSON_GetObjectItem(data, "noiseThreshold");
+	if (cJSON_IsNumber(noise_threshold)) {
+		if (noise_threshold->valuedouble >= 0.0)
+			cr_renderer_set_num_pref(ext, cr_renderer_noise_threshold, (uint64_t)(noise_threshold->valuedouble * 10000.0 + 0.5));
+		else
+			logr(warning, "Invalid noiseThreshold %f, expected 0 or more\n", noise_threshold->valuedouble);
+	}
+
+	const cJSON *pin_threads = cJSON_GetObjectItem(data, "pinThreads");
+	if (cJSON_IsBool(pin_threads)) {
+		cr_renderer_set_num_pref(ext, cr_renderer_pin_threads, cJSON_IsTrue(pin_threads));
+	}
+
+	const cJSON *integrator = cJSON_GetObjectItem(data, "integrator");
+	if (cJSON_IsString(integrator)) {
+		if (stringEquals(integrator->valuestring, "path"))
+			cr_renderer_set_num_pref(ext, cr_renderer_integrator, 0);
+		else if (stringEquals(integrator->valuestring, "wavefront"))
+			cr_renderer_set_num_pref(ext, cr_renderer_integrator, 1);
+		else
+			logr(warning, "Invalid integrator %s, expected path or wavefront\n", integrator->valuestring);
+	}
+
+	const cJSON *sampler = cJSON_GetObjectItem(data, "sampler");
+	if (cJSON_IsString(sampler)) {
+		static const char *samplers[] = { "halton", "hammersley", "random", "sobol" };
+		size_t i = 0;
+		while (i < sizeof(samplers) / sizeof(samplers[0]) && !stringEquals(sampler->valuestring, samplers[i]))
+			i++;
+		if (i < sizeof(samplers) / sizeof(samplers[0]))
+			cr_renderer_set_num_pref(ext, cr_renderer_sampler, i);
+		else
+			logr(warning, "Invalid sampler %s, expected halton, hammersley, random or sobol\n", sampler->valuestring);
+	}
+
+	const cJSON *bvh_cache = cJSON_GetObjectItem(data, "bvhCache");
+	if (cJSON_IsString(bvh_cache)) {
+		cr_renderer_set_str_pref(ext, cr_renderer_bvh_cache_path, bvh_cache->valuestring);
+	}
+
 }
 
 float getRadians(const cJSON *object) {
@@ -338,6 +404,14 @@ static void parse_mesh(struct cr_renderer *r, const cJSON *data, int idx, int me
 		if (maybe_override) cr_shader_node_free(maybe_override);
 	}
 
+	// Either a bool to use the default budget, or the budget itself
+	const cJSON *spatial_splits = cJSON_GetObjectItem(data, "spatialSplits");
+	float spatial_split_budget = 0.0f;
+	if (cJSON_IsNumber(spatial_splits) && spatial_splits->valuedouble > 0.0)
+		spatial_split_budget = spatial_splits->valuedouble;
+	else if (cJSON_IsTrue(spatial_splits))
+		spatial_split_budget = 0.5f;
+
 	// Now apply some slightly overcomplicated logic to choose instances to add to the scene.
 	// It boils down to:
 	// - If a 'pick_instances' array is found, only add those instances that were specified.
@@ -360,6 +434,7 @@ static void parse_mesh(struct cr_renderer *r, const cJSON *data, int idx, int me
 			cr_mesh mesh = cr_scene_mesh_new(scene, result.meshes.items[i].name);
 			cr_mesh_bind_vertex_buf(scene, mesh, vbuf);
 			cr_mesh_bind_faces(scene, mesh, result.meshes.items[i].faces.items, result.meshes.items[i].faces.count);
+			if (spatial_split_budget > 0.0f) cr_mesh_set_spatial_split_budget(scene, mesh, spatial_split_budget);
 			cr_instance m_instance = cr_instance_new(scene, mesh, cr_object_mesh);
 			cr_instance_bind_material_set(scene, m_instance, file_set);
 			cr_instance_set_transform(scene, m_instance, parse_composite_transform(cJSON_GetObjectItem(data, "transforms")).A.mtx);
@@ -380,6 +455,7 @@ static void parse_mesh(struct cr_renderer *r, const cJSON *data, int idx, int me
 					mesh = cr_scene_mesh_new(scene, result.meshes.items[i].name);
 					cr_mesh_bind_vertex_buf(scene, mesh, vbuf);
 					cr_mesh_bind_faces(scene, mesh, result.meshes.items[i].faces.items, result.meshes.items[i].faces.count);
+					if (spatial_split_budget > 0.0f) cr_mesh_set_spatial_split_budget(scene, mesh, spatial_split_budget);
 				}
 			}
 		}
@@ -423,35 +499,23 @@ static void parse_meshes(struct cr_renderer *r, const cJSON *data) {
 	}
 }
 
-static void parse_sphere(struct cr_renderer *r, const cJSON *data) {
+// Adds an instance of the given object for each entry in "instances". Instances that
+// don't have their own "materials" use the "material" of the primitive.
+static void parse_primitive_instances(struct cr_renderer *r, const cJSON *data, cr_object object, enum cr_object_type type) {
 	struct cr_scene *scene = cr_renderer_scene_get(r);
+	const cJSON *global_materials = cJSON_GetObjectItem(data, "material");
 
-	const cJSON *radius = NULL;
-	radius = cJSON_GetObjectItem(data, "radius");
-	float rad = 0.0f;
-	if (radius != NULL && cJSON_IsNumber(radius)) {
-		rad = radius->valuedouble;
-	} else {
-		rad = 1.0f;
-		logr(warning, "No radius specified for sphere, setting to %.0f\n", (double)rad);
-	}
-
-	cr_sphere new_sphere = cr_scene_add_sphere(scene, rad);
-	
-	// Apply this to all instances that don't have their own "materials" object
-	const cJSON *sphere_global_materials = cJSON_GetObjectItem(data, "material");
-	
 	const cJSON *instances = cJSON_GetObjectItem(data, "instances");
 	if (!cJSON_IsArray(instances)) return;
 	const cJSON *instance = NULL;
 	cJSON_ArrayForEach(instance, instances) {
 
-		cr_instance new_instance = cr_instance_new(scene, new_sphere, cr_object_sphere);
+		cr_instance new_instance = cr_instance_new(scene, object, type);
 
 		cr_material_set instance_set = cr_scene_new_material_set(scene);
 
 		const cJSON *instance_materials = cJSON_GetObjectItem(instance, "materials");
-		const cJSON *materials = instance_materials ? instance_materials : sphere_global_materials;
+		const cJSON *materials = instance_materials ? instance_materials : global_materials;
 
 		if (materials) {
 			const cJSON *material = NULL;
@@ -476,11 +540,63 @@ static void parse_sphere(struct cr_renderer *r, const cJSON *data) {
 	}
 }
 
+static void parse_sphere(struct cr_renderer *r, const cJSON *data) {
+	struct cr_scene *scene = cr_renderer_scene_get(r);
+
+	const cJSON *radius = NULL;
+	radius = cJSON_GetObjectItem(data, "radius");
+	float rad = 0.0f;
+	if (radius != NULL && cJSON_IsNumber(radius)) {
+		rad = radius->valuedouble;
+	} else {
+		rad = 1.0f;
+		logr(warning, "No radius specified for sphere, setting to %.0f\n", (double)rad);
+	}
+
+	cr_sphere new_sphere = cr_scene_add_sphere(scene, rad);
+	parse_primitive_instances(r, data, new_sphere, cr_object_sphere);
+}
+
+// Spheres are given as [x, y, z, radius] arrays
+static void parse_sphere_set(struct cr_renderer *r, const cJSON *data) {
+	struct cr_scene *scene = cr_renderer_scene_get(r);
+
+	const cJSON *spheres = cJSON_GetObjectItem(data, "spheres");
+	if (!cJSON_IsArray(spheres)) {
+		logr(warning, "No spheres specified for sphere set, skipping\n");
+		return;
+	}
+	size_t count = cJSON_GetArraySize(spheres);
+	struct cr_vector *centers = calloc(count, sizeof(*centers));
+	float *radii = calloc(count, sizeof(*radii));
+	size_t idx = 0;
+	const cJSON *sphere = NULL;
+	cJSON_ArrayForEach(sphere, spheres) {
+		if (!cJSON_IsArray(sphere) || cJSON_GetArraySize(sphere) != 4) {
+			logr(warning, "Invalid sphere at index %zu in sphere set, expected [x, y, z, radius]\n", idx);
+			continue;
+		}
+		centers[idx] = (struct cr_vector){
+			cJSON_GetNumberValue(cJSON_GetArrayItem(sphere, 0)),
+			cJSON_GetNumberValue(cJSON_GetArrayItem(sphere, 1)),
+			cJSON_GetNumberValue(cJSON_GetArrayItem(sphere, 2))
+		};
+		radii[idx++] = cJSON_GetNumberValue(cJSON_GetArrayItem(sphere, 3));
+	}
+
+	cr_sphere_set new_set = cr_scene_add_sphere_set(scene, centers, radii, idx);
+	free(centers);
+	free(radii);
+	parse_primitive_instances(r, data, new_set, cr_object_sphere_set);
+}
+
 static void parse_primitive(struct cr_renderer *r, const cJSON *data, int idx) {
 	const cJSON *type = NULL;
 	type = cJSON_GetObjectItem(data, "type");
 	if (stringEquals(type->valuestring, "sphere")) {
 		parse_sphere(r, data);
+	} else if (stringEquals(type->valuestring, "sphere_set")) {
+		parse_sphere_set(r, data);
 	} else {
 		logr(warning, "Unknown primitive type \"%s\" at index %i\n", type->valuestring, idx);
 	}
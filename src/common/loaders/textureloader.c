@@ -75,6 +75,14 @@ static struct texture *load_texture_from_buffer(const file_data data) {
 	return new;
 }
 
+bool texture_can_decode(const char *path, const file_data data) {
+	if (!data.items) return false;
+	if (guess_file_type(path) == qoi)
+		return data.count >= 14 && !memcmp(data.items, "qoif", 4); // 14 byte header
+	int width, height, channels;
+	return stbi_info_from_memory(data.items, (int)data.count, &width, &height, &channels);
+}
+
 struct texture *load_texture(const char *path, const file_data data) {
 	if (!data.items) return NULL;
 
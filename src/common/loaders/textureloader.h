@@ -12,3 +12,6 @@
 
 // Currently supports: JPEG, PNG, BMP, TGA, PIC, PNM, QOI, HDRI
 struct texture *load_texture(const char *path, const file_data data);
+
+// Only looks at the header, to check whether load_texture() can decode the data before actually decoding it
+bool texture_can_decode(const char *path, const file_data data);
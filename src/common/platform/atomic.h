@@ -0,0 +1,56 @@
+//
+//  atomic.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+// Platform-agnostic atomic operations on size_t values, all sequentially consistent.
+// We build as C99, so these stand in for <stdatomic.h>.
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef WINDOWS
+#include <Windows.h>
+
+static inline size_t cr_atomic_load(size_t *p) {
+	return (size_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
+
+static inline void cr_atomic_store(size_t *p, size_t value) {
+	InterlockedExchange64((volatile LONG64 *)p, (LONG64)value);
+}
+
+// Returns the value before the addition
+static inline size_t cr_atomic_add(size_t *p, size_t value) {
+	return (size_t)InterlockedExchangeAdd64((volatile LONG64 *)p, (LONG64)value);
+}
+
+// Replaces the value with desired if it still is expected
+static inline bool cr_atomic_cas(size_t *p, size_t expected, size_t desired) {
+	return (size_t)InterlockedCompareExchange64((volatile LONG64 *)p, (LONG64)desired, (LONG64)expected) == expected;
+}
+#else
+
+static inline size_t cr_atomic_load(size_t *p) {
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void cr_atomic_store(size_t *p, size_t value) {
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+// Returns the value before the addition
+static inline size_t cr_atomic_add(size_t *p, size_t value) {
+	return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+// Replaces the value with desired if it still is expected
+static inline bool cr_atomic_cas(size_t *p, size_t expected, size_t desired) {
+	return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
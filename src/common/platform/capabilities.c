@@ -6,7 +6,13 @@
 //  Copyright © 2020-2023 Valtteri Koskivuori. All rights reserved.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // For sched_getaffinity() & co
+#endif
+
 #include "capabilities.h"
+#include <stdlib.h>
+#include <stdint.h>
 
 #ifdef __APPLE__
 #include <sys/param.h>
@@ -17,6 +23,12 @@
 #include <unistd.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#include <stdio.h>
+#include <dirent.h>
+#endif
+
 int sys_get_cores() {
 #ifdef __APPLE__
 	int nm[2];
@@ -39,8 +51,145 @@ int sys_get_cores() {
 	GetSystemInfo(&sysInfo);
 	return sysInfo.dwNumberOfProcessors;
 #elif __linux__ || __COSMOPOLITAN__
+#ifdef __linux__
+	// Containers and taskset limit us to fewer CPUs than the system has
+	cpu_set_t set;
+	if (!sched_getaffinity(0, sizeof(set), &set))
+		return CPU_COUNT(&set);
+#endif
 	return (int)sysconf(_SC_NPROCESSORS_ONLN);
 #else
 	return 1;
 #endif
 }
+
+static int compare_placement(const void *a, const void *b) {
+	const struct cpu_info *lhs = a;
+	const struct cpu_info *rhs = b;
+	if (lhs->smt != rhs->smt) return lhs->smt < rhs->smt ? -1 : 1;
+	if (lhs->rank != rhs->rank) return lhs->rank < rhs->rank ? -1 : 1;
+	if (lhs->node != rhs->node) return lhs->node < rhs->node ? -1 : 1;
+	return lhs->cpu - rhs->cpu;
+}
+
+struct sys_topology sys_topology_from_cpus(struct cpu_info *infos, size_t count) {
+	struct sys_topology topology = { 0 };
+	for (size_t i = 0; i < count; ++i) {
+		infos[i].smt = 0;
+		for (size_t j = 0; j < i; ++j) {
+			if (infos[j].package == infos[i].package && infos[j].core == infos[i].core) infos[i].smt++;
+		}
+		if (!infos[i].smt) topology.physical_cores++;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		bool first_on_node = true;
+		infos[i].rank = 0;
+		for (size_t j = 0; j < i; ++j) {
+			if (infos[j].node == infos[i].node) first_on_node = false;
+			if (infos[j].node == infos[i].node && infos[j].smt == infos[i].smt) infos[i].rank++;
+		}
+		if (first_on_node) topology.numa_nodes++;
+	}
+	qsort(infos, count, sizeof(*infos), compare_placement);
+	topology.cpus = malloc(count * sizeof(*topology.cpus));
+	topology.cpu_count = count;
+	for (size_t i = 0; i < count; ++i)
+		topology.cpus[i] = infos[i].cpu;
+	return topology;
+}
+
+#ifdef __linux__
+
+static int read_cpu_int(const char *fmt, int cpu, int fallback) {
+	char path[128];
+	snprintf(path, sizeof(path), fmt, cpu);
+	FILE *file = fopen(path, "r");
+	if (!file) return fallback;
+	int value = fallback;
+	if (fscanf(file, "%d", &value) != 1) value = fallback;
+	fclose(file);
+	return value;
+}
+
+// sysfs lists a nodeN link in the directory of each CPU
+static int read_cpu_node(int cpu) {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	DIR *dir = opendir(path);
+	if (!dir) return 0;
+	int node = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+	}
+	closedir(dir);
+	return node;
+}
+
+struct sys_topology sys_get_topology(void) {
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set)) {
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < sys_get_cores() && cpu < CPU_SETSIZE; ++cpu)
+			CPU_SET(cpu, &set);
+	}
+	struct cpu_info *infos = calloc(CPU_COUNT(&set), sizeof(*infos));
+	size_t count = 0;
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (!CPU_ISSET(cpu, &set)) continue;
+		infos[count++] = (struct cpu_info){
+			.cpu = cpu,
+			.node = read_cpu_node(cpu),
+			.package = read_cpu_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu, 0),
+			.core = read_cpu_int("/sys/devices/system/cpu/cpu%d/topology/core_id", cpu, cpu),
+		};
+	}
+	struct sys_topology topology = sys_topology_from_cpus(infos, count);
+	free(infos);
+	return topology;
+}
+
+bool sys_set_thread_affinity(const int *cpus, size_t count) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < count; ++i) {
+		if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+	}
+	// 0 is the calling thread here, not the whole process
+	return !sched_setaffinity(0, sizeof(set), &set);
+}
+
+#else
+
+struct sys_topology sys_get_topology(void) {
+	const size_t count = (size_t)sys_get_cores();
+	struct cpu_info *infos = calloc(count, sizeof(*infos));
+	for (size_t i = 0; i < count; ++i)
+		infos[i] = (struct cpu_info){ .cpu = (int)i, .core = (int)i };
+	struct sys_topology topology = sys_topology_from_cpus(infos, count);
+	free(infos);
+	return topology;
+}
+
+bool sys_set_thread_affinity(const int *cpus, size_t count) {
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (cpus[i] >= 0 && cpus[i] < (int)(sizeof(mask) * 8)) mask |= (DWORD_PTR)1 << cpus[i];
+	}
+	return mask && SetThreadAffinityMask(GetCurrentThread(), mask);
+#else
+	// macOS only takes affinity hints, and only between threads
+	(void)cpus;
+	(void)count;
+	return false;
+#endif
+}
+
+#endif
+
+void sys_topology_free(struct sys_topology *topology) {
+	if (!topology) return;
+	free(topology->cpus);
+	*topology = (struct sys_topology){ 0 };
+}
@@ -8,7 +8,41 @@
 
 #pragma once
 
-/// Get amount of logical processing cores on the system
-/// @remark Is unaware of NUMA nodes on high core count systems
+#include <stddef.h>
+#include <stdbool.h>
+
+/// Get amount of logical processing cores this process is allowed to run on
+/// @remark Is unaware of NUMA nodes on high core count systems, see sys_get_topology() for those
 /// @return Amount of logical processing cores
 int sys_get_cores(void);
+
+struct sys_topology {
+	// Logical CPUs this process may run on, in the order threads should be placed on them:
+	// One per physical core first, spread evenly over NUMA nodes, and SMT siblings after those.
+	int *cpus;
+	size_t cpu_count;
+	size_t physical_cores;
+	size_t numa_nodes;
+};
+
+/// Discovers which logical CPUs share a physical core and a NUMA node
+/// @remark Only Linux reports more than a flat list of CPUs for now
+struct sys_topology sys_get_topology(void);
+
+struct cpu_info {
+	int cpu;
+	int node;
+	int package;
+	int core;
+	size_t smt; // Index among the logical CPUs of the same physical core
+	size_t rank; // Index among the CPUs on the same node with the same smt index
+};
+
+/// Orders the given CPUs for placement, see sys_get_topology()
+/// @param infos Logical CPUs, with cpu, node, package and core filled in. Gets sorted in place.
+struct sys_topology sys_topology_from_cpus(struct cpu_info *infos, size_t count);
+void sys_topology_free(struct sys_topology *topology);
+
+/// Restricts the calling thread to the given logical CPUs
+/// @return false if that isn't supported on this platform, or the CPUs are out of reach
+bool sys_set_thread_affinity(const int *cpus, size_t count);
@@ -23,6 +23,7 @@
 struct cr_task {
 	void (*fn)(void *arg);
 	void *arg;
+	struct cr_task_group *group;
 	struct cr_task *next;
 };
 
@@ -38,17 +39,26 @@ struct cr_thread_pool {
 	bool stop_flag;
 };
 
-static struct cr_task *task_create(void (*fn)(void *arg), void *arg) {
+static struct cr_task *task_create(void (*fn)(void *arg), void *arg, struct cr_task_group *group) {
 	if (!fn) return NULL;
 	struct cr_task *task = malloc(sizeof(*task));
 	*task = (struct cr_task){
 		.fn = fn,
 		.arg = arg,
+		.group = group,
 		.next = NULL
 	};
 	return task;
 }
 
+// Call with pool->mutex held
+static void task_finished(struct cr_thread_pool *pool, struct cr_task *task) {
+	// Threads waiting for a group sleep on work_available, so they get woken up here too.
+	if (task->group && --task->group->pending == 0)
+		thread_cond_broadcast(&pool->work_available);
+	free(task);
+}
+
 static struct cr_task *thread_pool_get_task(struct cr_thread_pool *pool) {
 	if (!pool) return NULL;
 	struct cr_task *task = pool->first;
@@ -72,11 +82,9 @@ static void *cr_worker(void *arg) {
 		struct cr_task *task = thread_pool_get_task(pool);
 		pool->active_workers++;
 		mutex_release(pool->mutex);
-		if (task) {
-			task->fn(task->arg);
-			free(task);
-		}
+		if (task) task->fn(task->arg);
 		mutex_lock(pool->mutex);
+		if (task) task_finished(pool, task);
 		pool->active_workers--;
 		if (!pool->stop_flag && pool->active_workers == 0 && !pool->first)
 			thread_cond_signal(&pool->work_ongoing);
@@ -109,6 +117,24 @@ struct cr_thread_pool *thread_pool_create(size_t threads) {
 	return pool;
 }
 
+void thread_pool_reserve(struct cr_thread_pool *pool, size_t threads) {
+	if (!pool) return;
+	mutex_lock(pool->mutex);
+	if (threads > pool->thread_count) {
+		logr(debug, "Growing thread pool (%lut -> %lut, %p)\n", pool->thread_count, threads, (void *)pool);
+		pool->threads = realloc(pool->threads, threads * sizeof(*pool->threads));
+		for (size_t i = pool->thread_count; i < threads; ++i) {
+			pool->threads[i] = (struct cr_thread){
+				.thread_fn = cr_worker,
+				.user_data = pool
+			};
+			thread_create_detach(&pool->threads[i]);
+		}
+		pool->thread_count = threads;
+	}
+	mutex_release(pool->mutex);
+}
+
 void thread_pool_destroy(struct cr_thread_pool *pool) {
 	if (!pool) return;
 	logr(debug, "Closing thread pool (%lut, %p)\n", pool->thread_count, (void *)pool);
@@ -136,11 +162,12 @@ void thread_pool_destroy(struct cr_thread_pool *pool) {
 	free(pool);
 }
 
-bool thread_pool_enqueue(struct cr_thread_pool *pool, void (*fn)(void *arg), void *arg) {
+static bool enqueue_task(struct cr_thread_pool *pool, struct cr_task_group *group, void (*fn)(void *arg), void *arg) {
 	if (!pool) return false;
-	struct cr_task *task = task_create(fn, arg);
+	struct cr_task *task = task_create(fn, arg, group);
 	if (!task) return false;
 	mutex_lock(pool->mutex);
+	if (group) group->pending++;
 	if (!pool->first) {
 		pool->first = task;
 		pool->last = pool->first;
@@ -153,6 +180,15 @@ bool thread_pool_enqueue(struct cr_thread_pool *pool, void (*fn)(void *arg), voi
 	return true;
 }
 
+bool thread_pool_enqueue(struct cr_thread_pool *pool, void (*fn)(void *arg), void *arg) {
+	return enqueue_task(pool, NULL, fn, arg);
+}
+
+bool thread_pool_enqueue_group(struct cr_thread_pool *pool, struct cr_task_group *group, void (*fn)(void *arg), void *arg) {
+	if (!group) return false;
+	return enqueue_task(pool, group, fn, arg);
+}
+
 void thread_pool_wait(struct cr_thread_pool *pool) {
 	if (!pool) return;
 	mutex_lock(pool->mutex);
@@ -165,3 +201,26 @@ void thread_pool_wait(struct cr_thread_pool *pool) {
 	}
 	mutex_release(pool->mutex);
 }
+
+void thread_pool_wait_group(struct cr_thread_pool *pool, struct cr_task_group *group) {
+	if (!pool || !group) return;
+	mutex_lock(pool->mutex);
+	while (group->pending) {
+		// Help out instead of just sleeping. Besides keeping this thread busy, this
+		// prevents deadlocks when every worker is waiting on a group of its own.
+		struct cr_task *task = thread_pool_get_task(pool);
+		if (!task) {
+			thread_cond_wait(&pool->work_available, pool->mutex);
+			continue;
+		}
+		pool->active_workers++;
+		mutex_release(pool->mutex);
+		task->fn(task->arg);
+		mutex_lock(pool->mutex);
+		task_finished(pool, task);
+		pool->active_workers--;
+		if (!pool->stop_flag && pool->active_workers == 0 && !pool->first)
+			thread_cond_signal(&pool->work_ongoing);
+	}
+	mutex_release(pool->mutex);
+}
@@ -6,13 +6,31 @@
 //  Copyright © 2024 Valtteri Koskivuori. All rights reserved.
 //
 
+#pragma once
+
 #include <stddef.h>
 #include <stdbool.h>
 
 struct cr_thread_pool;
 
+// A set of tasks that can be waited on separately from the rest of the pool.
+// Zero-initialize before use, and only touch it through the functions below.
+struct cr_task_group {
+	size_t pending;
+};
+
 struct cr_thread_pool *thread_pool_create(size_t threads);
 void thread_pool_destroy(struct cr_thread_pool *pool);
 
+// Spawns more threads if the pool has less than this many. Tasks that run for a long
+// time, like render threads, need a thread each to all make progress at the same time.
+void thread_pool_reserve(struct cr_thread_pool *pool, size_t threads);
+
 bool thread_pool_enqueue(struct cr_thread_pool *pool, void (*fn)(void *arg), void *arg);
 void thread_pool_wait(struct cr_thread_pool *pool);
+
+bool thread_pool_enqueue_group(struct cr_thread_pool *pool, struct cr_task_group *group, void (*fn)(void *arg), void *arg);
+
+// Blocks until every task in the group has finished. The calling thread runs queued
+// tasks while it waits, so this can also be called from a task running in the same pool.
+void thread_pool_wait_group(struct cr_thread_pool *pool, struct cr_task_group *group);
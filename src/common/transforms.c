@@ -325,3 +325,18 @@ bool mat_eq(const struct matrix4x4 mA, const struct matrix4x4 mB) {
 	}
 	return true;
 }
+
+enum tform_class tform_classify(const struct matrix4x4 m) {
+	// Exact comparisons, so that the cheaper classes give the same results as the full matrix math
+	for (unsigned i = 0; i < 3; ++i) {
+		for (unsigned j = 0; j < 3; ++j) {
+			if (i != j && m.mtx[i][j] != 0.0f) return tform_class_generic;
+		}
+	}
+	if (m.mtx[3][0] != 0.0f || m.mtx[3][1] != 0.0f || m.mtx[3][2] != 0.0f || m.mtx[3][3] != 1.0f) return tform_class_generic;
+	const float scale = m.mtx[0][0];
+	if (scale <= 0.0f || m.mtx[1][1] != scale || m.mtx[2][2] != scale) return tform_class_generic;
+	if (scale != 1.0f) return tform_class_translate_scale;
+	const bool translated = m.mtx[0][3] != 0.0f || m.mtx[1][3] != 0.0f || m.mtx[2][3] != 0.0f;
+	return translated ? tform_class_translate : tform_class_identity;
+}
@@ -30,6 +30,14 @@ struct transform {
 	struct matrix4x4 Ainv;
 };
 
+// What a transform does, from the cheapest to the most expensive to apply
+enum tform_class {
+	tform_class_identity = 0,
+	tform_class_translate,       // Translation only
+	tform_class_translate_scale, // Translation and a positive uniform scale
+	tform_class_generic,         // Anything else, applied with full matrix math
+};
+
 struct material;
 struct vector;
 struct boundingBox;
@@ -54,6 +62,7 @@ struct matrix4x4 mat_mul(struct matrix4x4 A, struct matrix4x4 B); //FIXME: Maybe
 struct matrix4x4 mat_abs(struct matrix4x4);
 struct matrix4x4 mat_id(void);
 bool mat_eq(struct matrix4x4, struct matrix4x4);
+enum tform_class tform_classify(struct matrix4x4);
 
 void tform_point(struct vector *vec, struct matrix4x4);
 void tform_vector(struct vector *vec, struct matrix4x4);
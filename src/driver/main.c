@@ -17,7 +17,6 @@
 #include "../common/hashtable.h"
 #include "../common/vendored/cJSON.h"
 #include "../common/json_loader.h"
-#include "../common/platform/capabilities.h"
 #include "encoders/encoder.h"
 #include "args.h"
 #include "sdl.h"
@@ -213,13 +212,11 @@ int main(int argc, char *argv[]) {
 	uint64_t bounces = cr_renderer_get_num_pref(renderer, cr_renderer_bounces);
 
 	logr(info, "Starting c-ray renderer for frame %zu\n", out_num);
-	bool sys_thread = threads == (size_t)sys_get_cores() + 2;
 	logr(info, "Rendering at %s%lu%s x %s%lu%s\n", KWHT, width, KNRM, KWHT, height, KNRM);
 	logr(info, "Rendering %s%zu%s samples with %s%zu%s bounces.\n", KBLU, samples, KNRM, KGRN, bounces, KNRM);
-	logr(info, "Rendering with %s%zu%s%s local thread%s.\n",
+	logr(info, "Rendering with %s%zu%s local thread%s.\n",
 		KRED,
-		sys_thread ? threads - 2 : threads,
-		sys_thread ? "+2" : "",
+		threads,
 		KNRM,
 		PLURAL(threads));
 
@@ -10,32 +10,79 @@
 
 #include "../renderer/samplers/sampler.h"
 #include "../renderer/instance.h"
+#include "../../common/fileio.h"
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct lightRay;
 struct hitRecord;
 struct mesh;
+struct sphere_set;
 struct poly;
 struct boundingBox;
+struct cr_thread_pool;
 
 struct bvh;
 
+/// Memory layout of BVH nodes, chosen when a BVH is built
+enum bvh_layout {
+	bvh_layout_float = 0,    // Full precision bounds
+	bvh_layout_quantized16,  // 16-bit bounds relative to the parent node, 32-bit indices
+	bvh_layout_quantized8,   // 8-bit bounds relative to the parent node, 32-bit indices
+};
+
+/// Algorithm used to build BVHs
+enum bvh_builder {
+	bvh_builder_sah = 0, // Binned SAH, with spatial splits if enabled. Slower builds, faster traversal
+	bvh_builder_fast,    // Morton order and locally-ordered clustering, for interactive scene edits
+};
+
+/// Scene-wide settings for mesh BVHs
+struct bvh_params {
+	enum bvh_layout layout;
+	enum bvh_builder builder; // Also used for the top-level BVH
+	bool spatial_splits; // Use spatial splits for meshes that don't set their own budget
+	char *cache_path; // Directory to keep mesh BVHs in between runs, or NULL to always build them
+};
+
 /// Returns the bounding box of the root of the given BVH
 struct boundingBox get_root_bbox(const struct bvh *bvh);
 
-/// Builds a BVH for a given mesh
+/// Builds a BVH for a given mesh. The SAH builder uses spatial splits if the mesh has a spatial split budget.
 /// @param mesh Mesh containing polygons to process
-/// @param count Amount of polygons given
-struct bvh *build_mesh_bvh(const struct mesh *mesh);
+/// @param layout Node layout, quantized layouts use less memory at the cost of slower traversal
+/// @param builder Build algorithm, trading build speed for traversal speed
+/// @param pool Optional thread pool to split the build of large meshes into tasks, or NULL
+struct bvh *build_mesh_bvh(const struct mesh *mesh, enum bvh_layout layout, enum bvh_builder builder, struct cr_thread_pool *pool);
 
 /// Builds a top-level BVH for a given set of instances
 /// @param instances Instances to build a top-level BVH for
-/// @param instanceCount Amount of instances
-struct bvh *build_top_level_bvh(const struct instance_arr instances);
+/// @param builder Build algorithm, trading build speed for traversal speed
+/// @param pool Optional thread pool to split the build into tasks, or NULL
+struct bvh *build_top_level_bvh(const struct instance_arr instances, enum bvh_builder builder, struct cr_thread_pool *pool);
+
+/// Builds a BVH for the spheres of a sphere set, and keeps a copy of them in the order its leaves reference them
+/// @param set Sphere set to process
+/// @param layout Node layout, quantized layouts use less memory at the cost of slower traversal
+/// @param builder Build algorithm, trading build speed for traversal speed
+/// @param pool Optional thread pool to split the build of large sets into tasks, or NULL
+struct bvh *build_sphere_set_bvh(const struct sphere_set *set, enum bvh_layout layout, enum bvh_builder builder, struct cr_thread_pool *pool);
 
-/// Intersect a ray with a scene top-level BVH
+/// Updates the bounds of a mesh BVH after its vertices moved, keeping the topology of the tree
+/// @return false if the tree quality has degraded too much, in which case it should be rebuilt
+bool refit_mesh_bvh(struct bvh *bvh, const struct mesh *mesh);
+
+/// Updates the bounds of a top-level BVH after instances moved, or after their meshes were refitted
+/// @return false if instances were added or removed, or if the tree should be rebuilt for quality
+bool refit_top_level_bvh(struct bvh *bvh, const struct instance_arr instances);
+
+/// Estimates the cost of tracing a ray through a top-level BVH, down to the primitives of its instances
+/// @return Cost relative to intersecting a single primitive
+float get_top_level_sah_cost(const struct bvh *bvh, const struct instance_arr instances);
+
+/// Intersect a ray with a scene top-level BVH. The hit record is filled in for the closest hit only.
 bool traverse_top_level_bvh(
 	const struct instance *instances,
 	const struct bvh *bvh,
@@ -43,13 +90,94 @@ bool traverse_top_level_bvh(
 	struct hitRecord *isect,
 	sampler *sampler);
 
+/// Intersect a ray with a mesh BVH. Only sets the distance, barycentric coordinates and polygon of the closest hit.
 bool traverse_bottom_level_bvh(
 	const struct mesh *mesh,
 	const struct lightRay *ray,
 	struct hitRecord *isect,
 	sampler *sampler);
 
+/// Intersect a ray with a sphere set BVH, several spheres at a time. Only sets the distance and the index of the closest sphere hit.
+bool traverse_sphere_set_bvh(
+	const struct sphere_set *set,
+	const struct lightRay *ray,
+	struct hitRecord *isect);
+
+/// Tests whether a ray hits anything in a scene top-level BVH closer than the given distance.
+/// Stops at the first hit found, and computes no surface data, which is all shadow rays need.
+/// @param max_dist Distance to the point the visibility is tested against, FLT_MAX for none
+bool traverse_top_level_bvh_occluded(
+	const struct instance *instances,
+	const struct bvh *bvh,
+	const struct lightRay *ray,
+	float max_dist,
+	sampler *sampler);
+
+/// Tests whether a ray hits anything in a mesh BVH closer than the given distance, see traverse_top_level_bvh_occluded()
+bool traverse_bottom_level_bvh_occluded(
+	const struct mesh *mesh,
+	const struct lightRay *ray,
+	float max_dist);
+
+/// Tests whether a ray hits any sphere of a sphere set closer than the given distance, see traverse_top_level_bvh_occluded()
+bool traverse_sphere_set_bvh_occluded(
+	const struct sphere_set *set,
+	const struct lightRay *ray,
+	float max_dist);
+
+/// Number of rays in the packets given to the packet traversal functions
+#define RAY_PACKET_SIZE 8
+
+/// Intersects a packet of rays with a scene top-level BVH. Rays are traced together for as long
+/// as they visit the same nodes, which pays off for coherent rays, like neighbouring camera rays.
+/// @param rays Array of RAY_PACKET_SIZE rays, only the active ones are read
+/// @param isects Array of RAY_PACKET_SIZE hit records, one per ray
+/// @param active Bit mask of the rays in the packet to trace
+/// @param samplers Array of RAY_PACKET_SIZE samplers, one per ray
+/// @return Bit mask of the rays that hit something
+unsigned traverse_top_level_bvh_packet(
+	const struct instance *instances,
+	const struct bvh *bvh,
+	const struct lightRay *rays,
+	struct hitRecord *isects,
+	unsigned active,
+	sampler **samplers);
+
+/// Intersects a packet of rays with a mesh BVH, see traverse_top_level_bvh_packet()
+unsigned traverse_bottom_level_bvh_packet(
+	const struct mesh *mesh,
+	const struct lightRay *rays,
+	struct hitRecord *isects,
+	unsigned active,
+	sampler **samplers);
+
+/// Returns the amount of memory used by the given BVH, in bytes
+size_t get_bvh_memory_usage(const struct bvh *bvh);
+
+/// Serializes the given BVH into a single heap-allocated buffer, to be written to disk
+/// @param key Hash of everything the BVH was built from, checked when loading it
+file_data serialize_bvh(const struct bvh *bvh, uint64_t key);
+
+/// Creates a BVH that uses the nodes in a serialized BVH in place, after validating it.
+/// On success, the BVH takes ownership of `data`, which has to come from file_load()
+/// @param key Expected key, a BVH serialized with a different one is rejected
+/// @param max_prim_count Number of primitives the BVH is meant for
+/// @return NULL if the data is damaged or stale, or was written by an incompatible build
+struct bvh *deserialize_bvh(file_data *data, uint64_t key, size_t max_prim_count);
+
 /// Frees the memory allocated by the given BVH
 void destroy_bvh(struct bvh *);
 
-void compute_accels(struct mesh_arr meshes);
+/// Builds BVHs for all meshes that don't have one yet, and refits the ones marked as dirty
+/// @param pool Pool to build on, or NULL to build on the calling thread
+/// @param meshes Meshes to process
+/// @param params Settings for all meshes
+/// @return true if any BVH changed, which also changes the bounds of the instances using it
+bool compute_accels(struct cr_thread_pool *pool, struct mesh_arr meshes, struct bvh_params params);
+
+/// Builds BVHs for all sphere sets that don't have one yet
+/// @param pool Pool to build on, or NULL to build on the calling thread
+/// @param sets Sphere sets to process
+/// @param params Settings for all sets, the cache path is ignored
+/// @return true if any BVH was built, which also changes the bounds of the instances using it
+bool compute_sphere_set_accels(struct cr_thread_pool *pool, struct sphere_set_arr sets, struct bvh_params params);
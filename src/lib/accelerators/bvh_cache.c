@@ -0,0 +1,184 @@
+//
+//  bvh_cache.c
+//  c-ray
+//
+//  Created by Valtteri on 16.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../includes.h"
+#include "bvh_cache.h"
+
+#include "../datatypes/mesh.h"
+#include "../datatypes/poly.h"
+#include "../../common/fileio.h"
+#include "../../common/hashtable.h"
+#include "../../common/logging.h"
+#include "../../common/string.h"
+#include "../../common/dyn_array.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WINDOWS
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+/*
+ * Mesh BVHs are cached on disk, in files named after a hash of the triangles of the mesh and
+ * the build settings. A cached BVH is only used if its key, the build configuration of c-ray
+ * that wrote it and the checksum of its contents all match, otherwise it gets rebuilt and
+ * overwritten. Files are written under a temporary name and then renamed, so that concurrent
+ * renders sharing a cache never see partially written files. Loading a BVH updates the
+ * modification time of its file, so that eviction deletes the least recently used ones first.
+ */
+
+#define BVH_CACHE_EXTENSION ".bvh"
+#define BVH_CACHE_TEMP_EXTENSION ".tmp"
+
+uint64_t bvh_cache_key(const struct mesh *mesh, enum bvh_layout layout, float spatial_split_budget) {
+	const uint64_t count = mesh->polygons.count;
+	const uint32_t layout_id = layout;
+	uint64_t h = hash64Init();
+	h = hash64Bytes(h, &count, sizeof(count));
+	h = hash64Bytes(h, &layout_id, sizeof(layout_id));
+	h = hash64Bytes(h, &spatial_split_budget, sizeof(spatial_split_budget));
+	const struct vector *vertices = mesh->vbuf->vertices.items;
+	for (size_t i = 0; i < mesh->polygons.count; ++i) {
+		const struct poly *p = &mesh->polygons.items[i];
+		const struct vector v[] = { vertices[p->vertexIndex[0]], vertices[p->vertexIndex[1]], vertices[p->vertexIndex[2]] };
+		h = hash64Bytes(h, v, sizeof(v));
+	}
+	return h;
+}
+
+static char *get_cache_file_path(const char *cache_path, uint64_t key) {
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx" BVH_CACHE_EXTENSION, (unsigned long long)key);
+	return stringConcat(cache_path, name);
+}
+
+// Unique per process and BVH, since several meshes can have identical triangles
+static char *get_temp_file_path(const char *cache_path, uint64_t key, const struct bvh *bvh) {
+#ifdef WINDOWS
+	const unsigned long pid = GetCurrentProcessId();
+#else
+	const unsigned long pid = getpid();
+#endif
+	char name[96];
+	snprintf(name, sizeof(name), "/%016llx.%lu.%zx" BVH_CACHE_TEMP_EXTENSION, (unsigned long long)key, pid, (size_t)bvh);
+	return stringConcat(cache_path, name);
+}
+
+static void make_directory(const char *path) {
+#ifdef WINDOWS
+	CreateDirectoryA(path, NULL);
+#else
+	mkdir(path, 0755);
+#endif
+}
+
+struct bvh *bvh_cache_load(const char *cache_path, uint64_t key, const struct mesh *mesh) {
+	char *path = get_cache_file_path(cache_path, key);
+	struct bvh *bvh = NULL;
+	if (is_valid_file(path)) {
+		file_data data = file_load(path);
+		bvh = deserialize_bvh(&data, key, mesh->polygons.count);
+		if (!bvh) {
+			logr(debug, "Ignoring stale cached BVH %s\n", path);
+			file_free(&data);
+		}
+#ifndef WINDOWS
+		if (bvh) utime(path, NULL);
+#endif
+	}
+	free(path);
+	return bvh;
+}
+
+bool bvh_cache_store(const char *cache_path, uint64_t key, const struct bvh *bvh) {
+	make_directory(cache_path);
+	char *path = get_cache_file_path(cache_path, key);
+	char *temp_path = get_temp_file_path(cache_path, key, bvh);
+	file_data data = serialize_bvh(bvh, key);
+
+	FILE *file = fopen(temp_path, "wb");
+	bool written = file && fwrite(data.items, 1, data.count, file) == data.count;
+	if (file && fclose(file)) written = false;
+#ifdef WINDOWS
+	if (written) remove(path);
+#endif
+	if (written && rename(temp_path, path)) written = false;
+	if (!written) {
+		logr(warning, "Couldn't write BVH to cache in %s: %s\n", cache_path, strerror(errno));
+		remove(temp_path);
+	}
+
+	free(data.items);
+	free(temp_path);
+	free(path);
+	return written;
+}
+
+struct cache_file {
+	char *path;
+	size_t size;
+	time_t last_use;
+};
+
+typedef struct cache_file cache_file;
+dyn_array_def(cache_file)
+
+static void cache_file_free(struct cache_file *file) {
+	free(file->path);
+}
+
+static int compare_last_use(const void *a, const void *b) {
+	const struct cache_file *left = a, *right = b;
+	return (left->last_use > right->last_use) - (left->last_use < right->last_use);
+}
+
+void bvh_cache_evict(const char *cache_path, size_t max_bytes) {
+#ifndef WINDOWS
+	DIR *dir = opendir(cache_path);
+	if (!dir) return;
+	struct cache_file_arr files = { .elem_free = cache_file_free };
+	size_t total = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		// Temporary files are left behind by renders that were killed while writing
+		if (!stringEndsWith(BVH_CACHE_EXTENSION, entry->d_name) && !stringEndsWith(BVH_CACHE_TEMP_EXTENSION, entry->d_name))
+			continue;
+		char *dir_path = stringConcat(cache_path, "/");
+		char *path = stringConcat(dir_path, entry->d_name);
+		free(dir_path);
+		struct stat file_stat;
+		if (stat(path, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+			free(path);
+			continue;
+		}
+		cache_file_arr_add(&files, (struct cache_file){ path, file_stat.st_size, file_stat.st_mtime });
+		total += file_stat.st_size;
+	}
+	closedir(dir);
+
+	if (total > max_bytes) {
+		qsort(files.items, files.count, sizeof(*files.items), compare_last_use);
+		size_t evicted = 0;
+		for (size_t i = 0; i < files.count && total > max_bytes; ++i) {
+			if (remove(files.items[i].path)) continue;
+			total -= files.items[i].size;
+			evicted++;
+		}
+		logr(info, "Evicted %zu BVHs from cache\n", evicted);
+	}
+	cache_file_arr_free(&files);
+#else
+	(void)cache_path;
+	(void)max_bytes;
+#endif
+}
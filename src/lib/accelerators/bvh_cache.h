@@ -0,0 +1,33 @@
+//
+//  bvh_cache.h
+//  c-ray
+//
+//  Created by Valtteri on 16.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "bvh.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct mesh;
+
+/// Computes the key of the BVH built for a mesh, from its triangles and the build settings
+/// @param mesh Mesh to hash the triangles of
+/// @param layout Node layout of the BVH
+/// @param spatial_split_budget Budget the BVH is built with, 0 without spatial splits
+uint64_t bvh_cache_key(const struct mesh *mesh, enum bvh_layout layout, float spatial_split_budget);
+
+/// Maps a previously stored BVH for the given key from the cache directory into memory
+/// @return The BVH, or NULL if there is no valid BVH for the key
+struct bvh *bvh_cache_load(const char *cache_path, uint64_t key, const struct mesh *mesh);
+
+/// Stores a BVH in the cache directory, creating it if needed
+bool bvh_cache_store(const char *cache_path, uint64_t key, const struct bvh *bvh);
+
+/// Deletes the least recently used BVHs from the cache directory, until it takes up at most `max_bytes`
+void bvh_cache_evict(const char *cache_path, size_t max_bytes);
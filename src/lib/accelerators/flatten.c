@@ -0,0 +1,134 @@
+//
+//  flatten.c
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../includes.h"
+#include "flatten.h"
+
+#include "bvh.h"
+#include "../datatypes/scene.h"
+#include "../datatypes/poly.h"
+#include "../../common/string.h"
+
+#include <stdint.h>
+
+// Where the data of a source buffer starts in the merged one
+struct vbuf_offset {
+	bool added;
+	int vertices;
+	int normals;
+	int texture_coords;
+};
+
+bool flatten_can_merge(const struct instance *instance) {
+	return isMesh(instance) && instance->tform_class == tform_class_identity;
+}
+
+static struct vbuf_offset append_vbuf(struct vertex_buffer *dst, const struct vertex_buffer *src) {
+	struct vbuf_offset offset = {
+		.added = true,
+		.vertices = (int)dst->vertices.count,
+		.normals = (int)dst->normals.count,
+		.texture_coords = (int)dst->texture_coords.count
+	};
+	for (size_t i = 0; i < src->vertices.count; ++i)
+		vector_arr_add(&dst->vertices, src->vertices.items[i]);
+	for (size_t i = 0; i < src->normals.count; ++i)
+		vector_arr_add(&dst->normals, src->normals.items[i]);
+	for (size_t i = 0; i < src->texture_coords.count; ++i)
+		coord_arr_add(&dst->texture_coords, src->texture_coords.items[i]);
+	return offset;
+}
+
+static void append_polygons(struct mesh *dst, const struct mesh *src, struct vbuf_offset offset, size_t material_offset) {
+	for (size_t i = 0; i < src->polygons.count; ++i) {
+		struct poly p = src->polygons.items[i];
+		for (int j = 0; j < MAX_CRAY_VERTEX_COUNT; ++j) {
+			p.vertexIndex[j] += offset.vertices;
+			// -1 means the polygon doesn't have these
+			if (p.normalIndex[j] >= 0) p.normalIndex[j] += offset.normals;
+			if (p.textureIndex[j] >= 0) p.textureIndex[j] += offset.texture_coords;
+		}
+		p.materialIndex += material_offset;
+		poly_arr_add(&dst->polygons, p);
+	}
+}
+
+struct flat_scene *flatten_scene(const struct world *scene) {
+	size_t candidates = 0;
+	for (size_t i = 0; i < scene->instances.count; ++i)
+		if (flatten_can_merge(&scene->instances.items[i])) candidates++;
+	if (candidates < 2)
+		return NULL;
+
+	struct flat_scene *flat = calloc(1, sizeof(*flat));
+	struct mesh merged = { .vbuf = &flat->vbuf, .name = stringCopy("flattened") };
+	bool emits_light = false;
+
+	// Instances of meshes from the same file share buffers, those only get copied once
+	struct vbuf_offset *vbuf_offsets = calloc(scene->v_buffers.count, sizeof(*vbuf_offsets));
+	size_t *bbuf_offsets = malloc(scene->shader_buffers.count * sizeof(*bbuf_offsets));
+	for (size_t i = 0; i < scene->shader_buffers.count; ++i)
+		bbuf_offsets[i] = SIZE_MAX;
+
+	for (size_t i = 0; i < scene->instances.count; ++i) {
+		const struct instance *instance = &scene->instances.items[i];
+		if (!flatten_can_merge(instance)) {
+			instance_arr_add(&flat->instances, *instance);
+			size_t_arr_add(&flat->kept, i);
+			continue;
+		}
+		const struct mesh *mesh = &scene->meshes.items[instance->object_idx];
+		const struct bsdf_buffer *bbuf = &scene->shader_buffers.items[instance->bbuf_idx];
+		if (bbuf_offsets[instance->bbuf_idx] == SIZE_MAX) {
+			// Material indices only have 16 bits, the rest of the instances are left as they are
+			if (flat->bbuf.bsdfs.count + bbuf->bsdfs.count > (1 << 16)) {
+				instance_arr_add(&flat->instances, *instance);
+				size_t_arr_add(&flat->kept, i);
+				continue;
+			}
+			bbuf_offsets[instance->bbuf_idx] = flat->bbuf.bsdfs.count;
+			for (size_t j = 0; j < bbuf->bsdfs.count; ++j)
+				bsdf_node_ptr_arr_add(&flat->bbuf.bsdfs, bbuf->bsdfs.items[j]);
+		}
+		if (!vbuf_offsets[mesh->vbuf_idx].added)
+			vbuf_offsets[mesh->vbuf_idx] = append_vbuf(&flat->vbuf, &scene->v_buffers.items[mesh->vbuf_idx]);
+		append_polygons(&merged, mesh, vbuf_offsets[mesh->vbuf_idx], bbuf_offsets[instance->bbuf_idx]);
+		emits_light |= instance->emits_light;
+		flat->merged_count++;
+	}
+	free(vbuf_offsets);
+	free(bbuf_offsets);
+
+	flat->source_count = scene->instances.count;
+	mesh_arr_add(&flat->meshes, merged);
+	struct instance instance = new_mesh_instance(&flat->meshes, 0, NULL, NULL);
+	instance.bbuf = &flat->bbuf;
+	instance.emits_light = emits_light;
+	instance_arr_add(&flat->instances, instance);
+	return flat;
+}
+
+bool flat_scene_refresh(struct flat_scene *flat, const struct world *scene) {
+	if (scene->instances.count != flat->source_count)
+		return false;
+	for (size_t i = 0; i < flat->kept.count; ++i)
+		flat->instances.items[i] = scene->instances.items[flat->kept.items[i]];
+	return true;
+}
+
+void destroy_flat_scene(struct flat_scene *flat) {
+	if (!flat) return;
+	instance_arr_free(&flat->instances);
+	size_t_arr_free(&flat->kept);
+	flat->meshes.elem_free = mesh_free;
+	mesh_arr_free(&flat->meshes);
+	vertex_buf_free(&flat->vbuf);
+	// The shader nodes belong to the scene
+	bsdf_node_ptr_arr_free(&flat->bbuf.bsdfs);
+	free(flat);
+}
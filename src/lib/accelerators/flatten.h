@@ -0,0 +1,45 @@
+//
+//  flatten.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include "../renderer/instance.h"
+#include "../datatypes/mesh.h"
+#include "../nodes/bsdfnode.h"
+#include "../../common/vector.h"
+
+struct world;
+
+// A render-time copy of the scene instance list, where all mesh instances without a transform
+// are merged into a single mesh. The top-level BVH then only has to sort out the instances
+// that actually move, and rays don't have to enter a separate mesh BVH for every static object.
+// The scene itself is left untouched, so this can be thrown away and redone after edits.
+struct flat_scene {
+	struct instance_arr instances; // Instances that were kept as they are, followed by the merged one
+	struct size_t_arr kept;        // Scene index of each instance that was kept
+	size_t source_count;           // Instances in the scene when it was flattened
+	struct mesh_arr meshes;        // The merged mesh, on its own so that instances can reference it
+	struct vertex_buffer vbuf;     // Vertex data of all merged meshes
+	struct bsdf_buffer bbuf;       // Shaders of all merged instances. Borrowed from the scene, not owned.
+	size_t merged_count;
+};
+
+// Merges the mesh instances of a scene that have an identity transform.
+// Instances need their shader buffers bound, and the meshes their vertex buffers.
+// Returns NULL if there are less than two instances to merge.
+struct flat_scene *flatten_scene(const struct world *scene);
+
+// Whether flatten_scene() merges this instance, as long as there's room for its materials
+bool flatten_can_merge(const struct instance *instance);
+
+// Copies the instances that were kept from the scene again, so that moving them doesn't need the
+// meshes merged again. Returns false if instances were added since, then it has to be redone.
+bool flat_scene_refresh(struct flat_scene *flat, const struct world *scene);
+
+void destroy_flat_scene(struct flat_scene *flat);
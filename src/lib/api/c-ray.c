@@ -18,6 +18,7 @@
 #include "../../common/gitsha1.h"
 #include "../../common/fileio.h"
 #include "../../common/platform/terminal.h"
+#include "../../common/platform/atomic.h"
 #include "../../common/assert.h"
 #include "../../common/texture.h"
 #include "../../common/string.h"
@@ -25,6 +26,7 @@
 #include "../protocol/worker.h"
 #include "../../common/hashtable.h"
 #include "../datatypes/camera.h"
+#include "../accelerators/bvh.h"
 #include "../../common/loaders/textureloader.h"
 #include "../../common/json_loader.h"
 #include "../protocol/protocol.h"
@@ -119,6 +121,45 @@ bool cr_renderer_set_num_pref(struct cr_renderer *ext, enum cr_renderer_param p,
 			r->prefs.blender_mode = num;
 			return true;
 		}
+		case cr_renderer_spatial_splits: {
+			r->prefs.bvh_params.spatial_splits = num;
+			return true;
+		}
+		case cr_renderer_bvh_precision: {
+			switch (num) {
+				case 32: r->prefs.bvh_params.layout = bvh_layout_float; return true;
+				case 16: r->prefs.bvh_params.layout = bvh_layout_quantized16; return true;
+				case 8: r->prefs.bvh_params.layout = bvh_layout_quantized8; return true;
+				default: return false;
+			}
+		}
+		case cr_renderer_bvh_builder: {
+			if (num > bvh_builder_fast) return false;
+			r->prefs.bvh_params.builder = num;
+			return true;
+		}
+		case cr_renderer_flatten_scene: {
+			r->prefs.flatten_scene = num;
+			return true;
+		}
+		case cr_renderer_noise_threshold: {
+			r->prefs.noise_threshold = num / 10000.0f;
+			return true;
+		}
+		case cr_renderer_pin_threads: {
+			r->prefs.pin_threads = num;
+			return true;
+		}
+		case cr_renderer_integrator: {
+			if (num > integrator_wavefront) return false;
+			r->prefs.integrator = num;
+			return true;
+		}
+		case cr_renderer_sampler: {
+			if (num > Sobol) return false;
+			r->prefs.sampler = num;
+			return true;
+		}
 		default: return false;
 	}
 	return false;
@@ -163,6 +204,11 @@ bool cr_renderer_set_str_pref(struct cr_renderer *ext, enum cr_renderer_param p,
 			r->prefs.node_list = stringCopy(str);
 			return true;
 		}
+		case cr_renderer_bvh_cache_path: {
+			if (r->prefs.bvh_params.cache_path) free(r->prefs.bvh_params.cache_path);
+			r->prefs.bvh_params.cache_path = stringCopy(str);
+			return true;
+		}
 		default: return false;
 	}
 	return false;
@@ -185,6 +231,8 @@ void cr_renderer_toggle_pause(struct cr_renderer *ext) {
 		// FIXME: What about network renderers?
 		r->state.workers.items[i].paused = !r->state.workers.items[i].paused;
 	}
+	// Threads waiting for more passes have to notice the pause
+	if (r->state.current_set) tile_set_wake(r->state.current_set);
 }
 
 const char *cr_renderer_get_str_pref(struct cr_renderer *ext, enum cr_renderer_param p) {
@@ -194,6 +242,7 @@ const char *cr_renderer_get_str_pref(struct cr_renderer *ext, enum cr_renderer_p
 		case cr_renderer_output_path: return r->prefs.imgFilePath;
 		case cr_renderer_output_name: return r->prefs.imgFileName;
 		case cr_renderer_asset_path: return r->scene->asset_path;
+		case cr_renderer_bvh_cache_path: return r->prefs.bvh_params.cache_path;
 		default: return NULL;
 	}
 	return NULL;
@@ -211,6 +260,20 @@ uint64_t cr_renderer_get_num_pref(struct cr_renderer *ext, enum cr_renderer_para
 		case cr_renderer_output_num: return r->prefs.imgCount;
 		case cr_renderer_override_width: return r->prefs.override_width;
 		case cr_renderer_override_height: return r->prefs.override_height;
+		case cr_renderer_spatial_splits: return r->prefs.bvh_params.spatial_splits;
+		case cr_renderer_bvh_precision: {
+			switch (r->prefs.bvh_params.layout) {
+				case bvh_layout_quantized16: return 16;
+				case bvh_layout_quantized8: return 8;
+				default: return 32;
+			}
+		}
+		case cr_renderer_bvh_builder: return r->prefs.bvh_params.builder;
+		case cr_renderer_flatten_scene: return r->prefs.flatten_scene;
+		case cr_renderer_noise_threshold: return (uint64_t)(r->prefs.noise_threshold * 10000.0f + 0.5f);
+		case cr_renderer_pin_threads: return r->prefs.pin_threads;
+		case cr_renderer_integrator: return r->prefs.integrator;
+		case cr_renderer_sampler: return r->prefs.sampler;
 		default: return 0; // TODO
 	}
 	return 0;
@@ -254,6 +317,18 @@ cr_sphere cr_scene_add_sphere(struct cr_scene *s_ext, float radius) {
 	return sphere_arr_add(&scene->spheres, (struct sphere){ .radius = radius });
 }
 
+cr_sphere_set cr_scene_add_sphere_set(struct cr_scene *s_ext, const struct cr_vector *centers, const float *radii, size_t count) {
+	// An empty set would have nothing to build a BVH over
+	if (!s_ext || !centers || !radii || !count) return -1;
+	struct world *scene = (struct world *)s_ext;
+	struct sphere_set new = { 0 };
+	for (size_t i = 0; i < count; ++i) {
+		vector_arr_add(&new.centers, *(struct vector *)&centers[i]);
+		float_arr_add(&new.radii, radii[i]);
+	}
+	return sphere_set_arr_add(&scene->sphere_sets, new);
+}
+
 cr_vertex_buf cr_scene_vertex_buf_new(struct cr_scene *s_ext, struct cr_vertex_buf_param in) {
 	if (!s_ext) return -1;
 	struct world *scene = (struct world *)s_ext;
@@ -284,6 +359,10 @@ void cr_mesh_bind_vertex_buf(struct cr_scene *s_ext, cr_mesh mesh, cr_vertex_buf
 	struct mesh *m = &scene->meshes.items[mesh];
 	if ((size_t)buf > scene->v_buffers.count - 1) return;
 	m->vbuf_idx = buf;
+	// Same faces, different vertex positions
+	if (m->bvh) m->bvh_dirty = true;
+	// Merged meshes have a copy of the vertices
+	scene->flat_dirty = true;
 }
 
 void cr_mesh_bind_faces(struct cr_scene *s_ext, cr_mesh mesh, struct cr_face *faces, size_t face_count) {
@@ -295,6 +374,12 @@ void cr_mesh_bind_faces(struct cr_scene *s_ext, cr_mesh mesh, struct cr_face *fa
 	for (size_t i = 0; i < face_count; ++i) {
 		poly_arr_add(&m->polygons, *(struct poly *)&faces[i]);
 	}
+	// The topology changed, so the BVH can't be refitted
+	destroy_bvh(m->bvh);
+	m->bvh = NULL;
+	m->bvh_dirty = false;
+	scene->instances_dirty = true;
+	scene->flat_dirty = true;
 }
 
 cr_mesh cr_scene_mesh_new(struct cr_scene *s_ext, const char *name) {
@@ -316,6 +401,19 @@ cr_mesh cr_scene_get_mesh(struct cr_scene *s_ext, const char *name) {
 	return -1;
 }
 
+bool cr_mesh_set_spatial_split_budget(struct cr_scene *s_ext, cr_mesh mesh, float budget) {
+	if (!s_ext || budget < 0.0f) return false;
+	struct world *scene = (struct world *)s_ext;
+	if ((size_t)mesh > scene->meshes.count - 1) return false;
+	struct mesh *m = &scene->meshes.items[mesh];
+	if (m->spatial_split_budget == budget) return true;
+	m->spatial_split_budget = budget;
+	// Rebuild with the new setting
+	destroy_bvh(m->bvh);
+	m->bvh = NULL;
+	return true;
+}
+
 cr_instance cr_instance_new(struct cr_scene *s_ext, cr_object object, enum cr_object_type type) {
 	if (!s_ext) return -1;
 	struct world *scene = (struct world *)s_ext;
@@ -327,6 +425,10 @@ cr_instance cr_instance_new(struct cr_scene *s_ext, cr_object object, enum cr_ob
 		case cr_object_sphere:
 			new = new_sphere_instance(&scene->spheres, object, NULL, NULL);
 			break;
+		case cr_object_sphere_set:
+			if ((size_t)object >= scene->sphere_sets.count) return -1;
+			new = new_sphere_set_instance(&scene->sphere_sets, object);
+			break;
 		default:
 			return -1;
 	}
@@ -350,12 +452,15 @@ void cr_instance_set_transform(struct cr_scene *s_ext, cr_instance instance, flo
 	struct world *scene = (struct world *)s_ext;
 	if ((size_t)instance > scene->instances.count - 1) return;
 	struct instance *i = &scene->instances.items[instance];
+	const bool could_merge = flatten_can_merge(i);
 	struct matrix4x4 mtx = mtx_convert(row_major);
-	i->composite = (struct transform){
+	instance_set_transform(i, (struct transform){
 		.A = mtx,
 		.Ainv = mat_invert(mtx)
-	};
+	});
 	scene->instances_dirty = true;
+	// Moving a merged instance, or moving one back to where it can be merged
+	if (flatten_can_merge(i) != could_merge) scene->flat_dirty = true;
 }
 
 void cr_instance_transform(struct cr_scene *s_ext, cr_instance instance, float row_major[4][4]) {
@@ -363,10 +468,16 @@ void cr_instance_transform(struct cr_scene *s_ext, cr_instance instance, float r
 	struct world *scene = (struct world *)s_ext;
 	if ((size_t)instance > scene->instances.count - 1) return;
 	struct instance *i = &scene->instances.items[instance];
+	const bool could_merge = flatten_can_merge(i);
 	struct matrix4x4 mtx = mtx_convert(row_major);
-	i->composite.A = mat_mul(i->composite.A, mtx);
-	i->composite.Ainv = mat_invert(i->composite.A);
+	const struct matrix4x4 composite = mat_mul(i->composite.A, mtx);
+	instance_set_transform(i, (struct transform){
+		.A = composite,
+		.Ainv = mat_invert(composite)
+	});
 	scene->instances_dirty = true;
+	// Moving a merged instance, or moving one back to where it can be merged
+	if (flatten_can_merge(i) != could_merge) scene->flat_dirty = true;
 }
 
 bool cr_instance_bind_material_set(struct cr_scene *s_ext, cr_instance instance, cr_material_set set) {
@@ -376,6 +487,8 @@ bool cr_instance_bind_material_set(struct cr_scene *s_ext, cr_instance instance,
 	if ((size_t)set > scene->shader_buffers.count - 1) return false;
 	struct instance *i = &scene->instances.items[instance];
 	i->bbuf_idx = set;
+	// A flattened scene has copies of the materials of static instances
+	if (flatten_can_merge(i)) scene->flat_dirty = true;
 	return true;
 }
 
@@ -779,6 +892,7 @@ void cr_material_set_add(struct cr_scene *s_ext, cr_material_set set, struct cr_
 	const struct bsdfNode *node = build_bsdf_node(s_ext, desc);
 	cr_shader_node_ptr_arr_add(&buf->descriptions, shader_deepcopy(desc));
 	bsdf_node_ptr_arr_add(&buf->bsdfs, node);
+	if (s->flat) s->flat_dirty = true;
 }
 
 void cr_renderer_render(struct cr_renderer *ext) {
@@ -811,32 +925,35 @@ void cr_renderer_restart_interactive(struct cr_renderer *ext) {
 	if (!r->state.result_buf) return;
 	if (!r->state.current_set) return;
 	struct camera *cam = &r->scene->cameras.items[r->prefs.selected_camera];
+	// Threads still rendering a tile write it out before pausing, so only clear the buffer after that.
+	// Restarting lets threads waiting for the previous pass of their tile give up and pause too.
+	// Threads already pausing acknowledge it again, in case one was just leaving the pause loop.
+	const bool was_paused = r->state.workers.items[0].paused;
+	for (size_t i = 0; i < r->prefs.threads; ++i) {
+		r->state.workers.items[i].paused = true;
+		r->state.workers.items[i].in_pause_loop = false;
+	}
+	tile_set_restart(r, r->state.current_set);
+	for (size_t i = 0; i < r->prefs.threads; ++i) {
+		const struct worker *worker = &r->state.workers.items[i];
+		while (!worker->in_pause_loop && !worker->thread_complete && !r->state.render_aborted)
+			timer_sleep_ms(1);
+	}
 	if (r->state.result_buf->width != (size_t)cam->width || r->state.result_buf->height != (size_t)cam->height) {
-		// Resize result buffer. First, pause render threads and wait for them to ack
 		logr(info, "Resizing result_buf (%zu,%zu) -> (%d,%d)\n", r->state.result_buf->width, r->state.result_buf->height, cam->width, cam->height);
-		cr_renderer_toggle_pause((struct cr_renderer *)r);
-		for (size_t i = 0; i < r->state.workers.count; ++i) {
-			while (!r->state.workers.items[i].in_pause_loop) {
-				timer_sleep_ms(1);
-			}
-		}
-		// Okay, threads are now paused, swap the buffer
 		destroyTexture(r->state.result_buf);
 		r->state.result_buf = newTexture(float_p, cam->width, cam->height, 4);
-
-		cr_renderer_toggle_pause((struct cr_renderer *)r);
+	} else {
+		tex_clear(r->state.result_buf);
 	}
-	// sus
-	r->state.finishedPasses = 1;
-	mutex_lock(r->state.current_set->tile_mutex);
-	tex_clear(r->state.result_buf);
-	r->state.current_set->finished = 0;
+	// Again, as tiles handed out while pausing are stale as well
+	tile_set_restart(r, r->state.current_set);
 	for (size_t i = 0; i < r->prefs.threads; ++i) {
 		// FIXME: Use array for workers
 		// FIXME: What about network renderers?
 		r->state.workers.items[i].totalSamples = 0;
+		r->state.workers.items[i].paused = was_paused;
 	}
-	mutex_release(r->state.current_set->tile_mutex);
 }
 
 struct cr_bitmap *cr_renderer_get_result(struct cr_renderer *ext) {
@@ -68,8 +68,10 @@ static inline float triangleDistribution(float v) {
 struct lightRay cam_get_ray(const struct camera *cam, int x, int y, struct sampler *sampler) {
 	struct lightRay new_ray = { .type = rt_camera };
 	
-	const float jitter_x = triangleDistribution(getDimension(sampler));
-	const float jitter_y = triangleDistribution(getDimension(sampler));
+	float jitter[2];
+	getDimensions(sampler, jitter, 2);
+	const float jitter_x = triangleDistribution(jitter[0]);
+	const float jitter_y = triangleDistribution(jitter[1]);
 	
 	const struct vector pix_x = vec_scale(cam->is_blender ? cam->right : vec_negate(cam->right), (cam->sensor_size.x / cam->width));
 	const struct vector pix_y = vec_scale(cam->up, (cam->sensor_size.y / cam->height));
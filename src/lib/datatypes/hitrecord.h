@@ -18,6 +18,7 @@ struct hitRecord {
 	struct coord uv;				//UV barycentric coordinates for intersection point
 	const struct bsdfNode *bsdf;	//Surface properties of the intersected object
 	struct poly *polygon;			//ptr to polygon that was encountered
+	size_t primIndex;				//Sphere that was encountered, for sphere sets
 	float distance;					//Distance to intersection point
 	int instIndex;					//Instance index, negative if no intersection
 };
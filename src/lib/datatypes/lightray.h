@@ -13,7 +13,7 @@
 
 enum ray_type {
 	rt_camera       = 1 << 1,
-	rt_shadow       = 1 << 2,  // TODO
+	rt_shadow       = 1 << 2,  // Visibility only, see traverse_top_level_bvh_occluded()
 	rt_diffuse      = 1 << 3,
 	rt_glossy       = 1 << 4,
 	rt_singular     = 1 << 5, // TODO
@@ -24,6 +24,8 @@ struct mesh {
 	float surface_area;
 	char *name;
 	float rayOffset;
+	float spatial_split_budget; // Extra primitive references allowed for a spatial split BVH, 0 to disable
+	bool bvh_dirty; // Vertices moved since the BVH was built, refit it before rendering
 };
 
 typedef struct mesh mesh;
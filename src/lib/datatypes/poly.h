@@ -10,6 +10,8 @@
 
 #include "../../includes.h"
 #include "../../common/dyn_array.h"
+#include "../../common/vector.h"
+#include "hitrecord.h"
 #include <c-ray/c-ray.h>
 
 struct poly {
@@ -23,9 +25,45 @@ struct poly {
 typedef struct poly poly;
 dyn_array_def(poly)
 
-struct lightRay;
-struct hitRecord;
+// Polygon vertices in the form used by the intersection test, so that it doesn't have to look them up
+// or recompute the edges and normal every time. Mesh BVHs keep these in the order of their leaves.
+struct triangle {
+	struct vector v0;
+	struct vector e1; // v0 - v1
+	struct vector e2; // v2 - v0
+	struct vector n;  // Unnormalized geometric normal, cross(e1, e2)
+};
+
 struct mesh;
 
+struct triangle make_triangle(const struct mesh *mesh, const struct poly *poly);
+
+// Möller-Trumbore ray-triangle intersection routine
+// (see "Fast, Minimum Storage Ray-Triangle Intersection", by T. Möller and B. Trumbore)
+// Only sets the distance and barycentric coordinates of the hit, see polygonHitAttributes()
+static inline bool rayIntersectsWithTriangle(const struct triangle *tri, const struct lightRay *ray, struct hitRecord *isect) {
+	struct vector c = vec_sub(tri->v0, ray->start);
+	struct vector r = vec_cross(ray->direction, c);
+	float invDet = 1.0f / vec_dot(tri->n, ray->direction);
+
+	float u = vec_dot(r, tri->e2) * invDet;
+	float v = vec_dot(r, tri->e1) * invDet;
+
+	// This order of comparisons guarantees that none of u, v, or t, are NaNs:
+	// IEEE-754 mandates that they compare to false if the left hand side is a NaN.
+	if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f) {
+		float t = vec_dot(tri->n, c) * invDet;
+		if (t >= 0.0f && t < isect->distance) {
+			isect->uv = (struct coord) { u, v };
+			isect->distance = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Fills in the rest of the hit record for the closest hit found with rayIntersectsWithTriangle()
+void polygonHitAttributes(const struct mesh *mesh, const struct poly *poly, const struct triangle *tri, const struct lightRay *ray, struct hitRecord *isect);
+
 //Calculates intersection between a light ray and a polygon object. Returns true if intersection has happened.
 bool rayIntersectsWithPolygon(const struct mesh *mesh, const struct lightRay *ray, const struct poly *poly, struct hitRecord *isect);
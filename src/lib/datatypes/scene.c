@@ -27,12 +27,15 @@ void tex_asset_free(struct texture_asset *a) {
 
 void scene_destroy(struct world *scene) {
 	if (scene) {
+		thread_pool_wait_group(scene->pool, &scene->texture_loads);
 		scene->textures.elem_free = tex_asset_free;
 		texture_asset_arr_free(&scene->textures);
 		camera_arr_free(&scene->cameras);
 		scene->meshes.elem_free = mesh_free;
 		mesh_arr_free(&scene->meshes);
 		destroy_bvh(scene->topLevel);
+		destroy_flat_scene(scene->flat);
+		light_list_free(&scene->lights);
 		destroyHashtable(scene->storage.node_table);
 		destroyBlocks(scene->storage.node_pool);
 
@@ -46,6 +49,8 @@ void scene_destroy(struct world *scene) {
 		vertex_buffer_arr_free(&scene->v_buffers);
 		instance_arr_free(&scene->instances);
 		sphere_arr_free(&scene->spheres);
+		scene->sphere_sets.elem_free = sphere_set_free;
+		sphere_set_arr_free(&scene->sphere_sets);
 		if (scene->asset_path) free(scene->asset_path);
 		free(scene);
 	}
@@ -11,9 +11,12 @@
 #include <stddef.h>
 #include "../datatypes/mesh.h"
 #include "../renderer/instance.h"
+#include "../renderer/lights.h"
 #include "camera.h"
 #include "../../common/texture.h"
 #include "../nodes/bsdfnode.h"
+#include "../accelerators/flatten.h"
+#include "../../common/platform/thread_pool.h"
 
 struct renderer;
 struct hashtable;
@@ -39,9 +42,19 @@ struct world {
 	// Top-level bounding volume hierarchy,
 	// contains all 3D assets in the scene.
 	struct bvh *topLevel; // FIXME: Move to state?
+	// Static meshes merged together, if enabled. The top-level BVH is built over these instances then.
+	struct flat_scene *flat;
+	bool flat_dirty; // The merged instances, or their meshes or materials changed, so flat has to be redone
 	struct sphere_arr spheres;
+	struct sphere_set_arr sphere_sets;
+	// Emissive primitives for next event estimation, rebuilt at the start of each render
+	struct light_list lights;
 	struct camera_arr cameras;
 	struct node_storage storage; // FIXME: Move to state?
+	// Borrowed from the renderer. Image textures are decoded on it in the background,
+	// wait for texture_loads before reading them.
+	struct cr_thread_pool *pool;
+	struct cr_task_group texture_loads;
 
 	// c-ray is Y up, blender is Z up. This flag toggles
 	// between the two in c-ray.
@@ -50,4 +63,9 @@ struct world {
 	char *asset_path;
 };
 
+// The instances that the top-level BVH was built over
+static inline struct instance_arr scene_traced_instances(const struct world *scene) {
+	return scene->flat ? scene->flat->instances : scene->instances;
+}
+
 void scene_destroy(struct world *scene);
@@ -10,6 +10,7 @@
 #include "sphere.h"
 
 #include "../renderer/pathtrace.h"
+#include "../accelerators/bvh.h"
 #include "lightray.h"
 
 //Calculates intersection with a sphere and a light ray
@@ -47,11 +48,26 @@ bool intersect(const struct lightRay *ray, const struct sphere *sphere, float *t
 
 bool rayIntersectsWithSphere(const struct lightRay *ray, const struct sphere *sphere, struct hitRecord *isect) {
 	if (intersect(ray, sphere, &isect->distance)) {
-		//Compute normal and store it to isect
-		isect->hitPoint = alongRay(ray, isect->distance);
-		isect->surfaceNormal = vec_normalize(isect->hitPoint);
 		isect->polygon = NULL;
 		return true;
 	}
 	return false;
 }
+
+void sphereHitAttributes(const struct lightRay *ray, struct hitRecord *isect) {
+	//Compute normal and store it to isect
+	isect->hitPoint = alongRay(ray, isect->distance);
+	isect->surfaceNormal = vec_normalize(isect->hitPoint);
+}
+
+bool rayOccludedBySphere(const struct lightRay *ray, const struct sphere *sphere, float max_dist) {
+	return intersect(ray, sphere, &max_dist);
+}
+
+void sphere_set_free(struct sphere_set *set) {
+	if (set) {
+		vector_arr_free(&set->centers);
+		float_arr_free(&set->radii);
+		destroy_bvh(set->bvh);
+	}
+}
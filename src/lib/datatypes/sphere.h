@@ -20,4 +20,25 @@ struct sphere {
 typedef struct sphere sphere;
 dyn_array_def(sphere)
 
+// Many spheres rendered as a single object, e.g. particles. The spheres get a BVH of their own,
+// so the whole set takes up a single instance in the top-level BVH.
+struct sphere_set {
+	struct vector_arr centers;
+	struct float_arr radii;
+	struct bvh *bvh;
+	float rayOffset;
+};
+
+typedef struct sphere_set sphere_set;
+dyn_array_def(sphere_set)
+
+void sphere_set_free(struct sphere_set *set);
+
+// Only sets the distance of the hit, see sphereHitAttributes()
 bool rayIntersectsWithSphere(const struct lightRay *ray, const struct sphere *sphere, struct hitRecord *isect);
+
+// Fills in the hit point and normal for the closest hit found with rayIntersectsWithSphere()
+void sphereHitAttributes(const struct lightRay *ray, struct hitRecord *isect);
+
+// Returns true if the ray hits the sphere closer than max_dist, without computing any surface data
+bool rayOccludedBySphere(const struct lightRay *ray, const struct sphere *sphere, float max_dist);
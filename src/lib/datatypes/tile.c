@@ -12,73 +12,201 @@
 
 #include "../../common/logging.h"
 #include "../../common/platform/mutex.h"
+#include "../../common/platform/atomic.h"
 #include "../vendored/pcg_basic.h"
 #include <string.h>
 
 static void tiles_reorder(struct render_tile_arr *tiles, enum render_order tileOrder);
 
 struct render_tile *tile_next(struct tile_set *set) {
+	const size_t next = cr_atomic_add(&set->next, 1);
+	if (next < set->tiles.count) {
+		struct render_tile *tile = &set->tiles.items[next];
+		tile->state = rendering;
+		tile->index = next;
+		return tile;
+	}
+	// If a network worker disappeared during render, finish those tiles locally here at the end
 	struct render_tile *tile = NULL;
 	mutex_lock(set->tile_mutex);
-	if (set->finished < set->tiles.count) {
-		tile = &set->tiles.items[set->finished];
-		tile->state = rendering;
-		tile->index = set->finished++;
-	} else {
-		// If a network worker disappeared during render, finish those tiles locally here at the end
-		for (size_t t = 0; t < set->tiles.count; ++t) {
-			if (set->tiles.items[t].state == rendering && set->tiles.items[t].network_renderer) {
-				set->tiles.items[t].network_renderer = false;
-				tile = &set->tiles.items[t];
-				tile->state = rendering;
-				tile->index = t;
-				break;
-			}
+	for (size_t t = 0; t < set->tiles.count; ++t) {
+		if (set->tiles.items[t].state == rendering && set->tiles.items[t].network_renderer) {
+			set->tiles.items[t].network_renderer = false;
+			tile = &set->tiles.items[t];
+			tile->state = rendering;
+			tile->index = t;
+			break;
 		}
 	}
 	mutex_release(set->tile_mutex);
 	return tile;
 }
 
-struct render_tile *tile_next_interactive(struct renderer *r, struct tile_set *set) {
-	struct render_tile *tile = NULL;
+// The top byte of set->next counts restarts, and wraps around. A waiter would have to sleep
+// through 256 restarts to mistake a stale tile for a current one.
+#define TILE_GENERATION_SHIFT (sizeof(size_t) * 8 - 8)
+
+static inline size_t claim_index(size_t claim) {
+	return claim & (((size_t)1 << TILE_GENERATION_SHIFT) - 1);
+}
+
+static inline size_t claim_generation(size_t claim) {
+	return claim >> TILE_GENERATION_SHIFT;
+}
+
+static bool should_stop(const struct renderer *r) {
+	return r->state.render_aborted || !r->state.rendering;
+}
+
+// Blocks until the condition holds, or the render gets stopped. Returns false if it was stopped.
+static bool wait_for(struct renderer *r, struct tile_set *set, bool (*condition)(struct renderer *, struct tile_set *, const void *), const void *arg) {
+	if (condition(r, set, arg)) return true;
 	mutex_lock(set->tile_mutex);
-	again:
-	if (r->state.finishedPasses < r->prefs.sampleCount + 1) {
-		if (set->finished < set->tiles.count) {
-			tile = &set->tiles.items[set->finished];
-			tile->state = rendering;
-			tile->index = set->finished++;
-		} else {
-			r->state.finishedPasses++;
-			struct cr_renderer_cb_info cb_info = { 0 };
-			cb_info.finished_passes = r->state.finishedPasses - 1;
-			struct callback cb = r->state.callbacks[cr_cb_on_interactive_pass_finished];
-			if (cb.fn) cb.fn(&cb_info, cb.user_data);
-			set->finished = 0;
-			goto again;
-		}
-	}
-	if (!tile) {
-		// FIXME: shared state to indicate pause instead of accessing worker state
-		if (r->state.render_aborted || r->state.workers.items[0].paused) {
-			mutex_release(set->tile_mutex);
+	cr_atomic_add(&set->waiting, 1);
+	while (!condition(r, set, arg) && !should_stop(r))
+		thread_cond_wait(set->tile_done, set->tile_mutex);
+	cr_atomic_add(&set->waiting, (size_t)-1);
+	mutex_release(set->tile_mutex);
+	return !should_stop(r);
+}
+
+static bool have_passes_left(struct renderer *r, struct tile_set *set, const void *arg) {
+	(void)arg;
+	// FIXME: shared state to indicate pause instead of accessing worker state
+	return r->state.workers.items[0].paused || claim_index(cr_atomic_load(&set->next)) < set->tiles.count * r->prefs.sampleCount;
+}
+
+struct pass_wait {
+	struct render_tile *tile;
+	size_t pass;
+	size_t generation;
+};
+
+bool tile_set_restarted(struct tile_set *set, size_t generation) {
+	return claim_generation(cr_atomic_load(&set->next)) != generation;
+}
+
+static bool previous_pass_done(struct renderer *r, struct tile_set *set, const void *arg) {
+	(void)r;
+	const struct pass_wait *wait = arg;
+	return tile_set_restarted(set, wait->generation) || cr_atomic_load(&wait->tile->completed_samples) + 1 >= wait->pass;
+}
+
+struct render_tile *tile_next_interactive(struct renderer *r, struct tile_set *set, size_t *pass, size_t *generation) {
+	for (;;) {
+		if (!wait_for(r, set, have_passes_left, NULL) || r->state.workers.items[0].paused)
 			return NULL;
-		}
-		// FIXME: Use an atomic conditional for this, instead of polling here
-		timer_sleep_ms(32);
-		goto again;
+		const size_t claim = cr_atomic_add(&set->next, 1);
+		const size_t next = claim_index(claim);
+		if (next >= set->tiles.count * r->prefs.sampleCount)
+			continue;
+		struct render_tile *tile = &set->tiles.items[next % set->tiles.count];
+		*pass = next / set->tiles.count + 1;
+		*generation = claim_generation(claim);
+		// With more threads than tiles, a tile can come up again before its previous pass is done.
+		// This doesn't give up if paused, or the pass would never get done.
+		if (!wait_for(r, set, previous_pass_done, &(struct pass_wait){ tile, *pass, *generation }))
+			return NULL;
+		// The render was restarted while waiting, so this pass is already handed out again
+		if (tile_set_restarted(set, *generation))
+			continue;
+		tile->state = rendering;
+		tile->index = next % set->tiles.count;
+		return tile;
+	}
+}
+
+void tile_finish_interactive(struct renderer *r, struct tile_set *set, struct render_tile *tile, size_t pass, size_t generation) {
+	tile->state = finished;
+	// Restarts hold the mutex too, so passes from before one can't count towards the passes after it
+	mutex_lock(set->tile_mutex);
+	if (tile_set_restarted(set, generation) || !cr_atomic_cas(&tile->completed_samples, pass - 1, pass)) {
+		mutex_release(set->tile_mutex);
+		return;
 	}
+	if (cr_atomic_load(&set->waiting))
+		thread_cond_broadcast(set->tile_done);
+	// A pass is done once every tile has been rendered for it
+	const size_t finished_passes = cr_atomic_load(&r->state.finishedPasses);
+	size_t done = SIZE_MAX;
+	for (size_t t = 0; t < set->tiles.count && done >= finished_passes; ++t)
+		done = min(done, cr_atomic_load(&set->tiles.items[t].completed_samples));
+	if (done + 1 > finished_passes)
+		cr_atomic_store(&r->state.finishedPasses, done + 1);
 	mutex_release(set->tile_mutex);
-	return tile;
+
+	// Reported without the mutex, in case the callback restarts the render
+	struct callback cb = r->state.callbacks[cr_cb_on_interactive_pass_finished];
+	for (size_t p = finished_passes; p < done + 1 && cb.fn; ++p) {
+		struct cr_renderer_cb_info cb_info = { 0 };
+		cb_info.finished_passes = p;
+		cb.fn(&cb_info, cb.user_data);
+	}
 }
 
-struct tile_set tile_quantize(unsigned width, unsigned height, unsigned tile_w, unsigned tile_h, enum render_order order) {
+size_t tile_set_started(struct tile_set *set) {
+	return min(claim_index(cr_atomic_load(&set->next)), set->tiles.count);
+}
+
+void tile_set_restart(struct renderer *r, struct tile_set *set) {
+	mutex_lock(set->tile_mutex);
+	// Only restarts change the generation, and those hold the mutex
+	const size_t generation = claim_generation(cr_atomic_load(&set->next)) + 1;
+	cr_atomic_store(&set->next, generation << TILE_GENERATION_SHIFT);
+	for (size_t t = 0; t < set->tiles.count; ++t)
+		cr_atomic_store(&set->tiles.items[t].completed_samples, 0);
+	cr_atomic_store(&r->state.finishedPasses, 1);
+	thread_cond_broadcast(set->tile_done);
+	mutex_release(set->tile_mutex);
+}
+
+void tile_set_wake(struct tile_set *set) {
+	mutex_lock(set->tile_mutex);
+	thread_cond_broadcast(set->tile_done);
+	mutex_release(set->tile_mutex);
+}
+
+// Splits the tiles rendered last into quarters. With one tile per thread at the end of a render,
+// threads that got a quick tile would otherwise sit idle while the rest finish theirs.
+static size_t split_tail(struct render_tile_arr *tiles, size_t threads) {
+	const size_t tail = min(threads, tiles->count);
+	if (!tail) return 0;
+	struct render_tile_arr split = { 0 };
+	for (size_t i = 0; i < tiles->count - tail; ++i)
+		render_tile_arr_add(&split, tiles->items[i]);
+	for (size_t i = tiles->count - tail; i < tiles->count; ++i) {
+		const struct render_tile tile = tiles->items[i];
+		const int mid_x = tile.width > 1 ? tile.begin.x + (int)tile.width / 2 : tile.end.x;
+		const int mid_y = tile.height > 1 ? tile.begin.y + (int)tile.height / 2 : tile.end.y;
+		const int xs[] = { tile.begin.x, mid_x, tile.end.x };
+		const int ys[] = { tile.begin.y, mid_y, tile.end.y };
+		for (int y = 0; y < 2; ++y) {
+			for (int x = 0; x < 2; ++x) {
+				if (xs[x] == xs[x + 1] || ys[y] == ys[y + 1]) continue;
+				struct render_tile part = tile;
+				part.begin = (struct intCoord){ xs[x], ys[y] };
+				part.end = (struct intCoord){ xs[x + 1], ys[y + 1] };
+				part.width = part.end.x - part.begin.x;
+				part.height = part.end.y - part.begin.y;
+				part.index = (int)split.count;
+				render_tile_arr_add(&split, part);
+			}
+		}
+	}
+	const size_t added = split.count - tiles->count;
+	render_tile_arr_free(tiles);
+	*tiles = split;
+	return added;
+}
+
+struct tile_set tile_quantize(unsigned width, unsigned height, unsigned tile_w, unsigned tile_h, enum render_order order, size_t threads) {
 
 	logr(info, "Quantizing render plane\n");
 
 	struct tile_set set = { 0 };
 	set.tile_mutex = mutex_create();
+	set.tile_done = calloc(1, sizeof(*set.tile_done));
+	thread_cond_init(set.tile_done);
 
 	//Sanity check on tilesizes
 	if (tile_w >= width) tile_w = width;
@@ -121,6 +249,9 @@ struct tile_set tile_quantize(unsigned width, unsigned height, unsigned tile_w,
 
 	tiles_reorder(&set.tiles, order);
 
+	const size_t added = split_tail(&set.tiles, threads);
+	if (added) logr(debug, "Split the last %zu tiles to get %zu more\n", min(threads, set.tiles.count - added), added);
+
 	return set;
 }
 
@@ -128,6 +259,9 @@ void tile_set_free(struct tile_set *set) {
 	render_tile_arr_free(&set->tiles);
 	mutex_destroy(set->tile_mutex);
 	set->tile_mutex = NULL;
+	thread_cond_destroy(set->tile_done);
+	free(set->tile_done);
+	set->tile_done = NULL;
 }
 
 static void reorder_top_to_bottom(struct render_tile_arr *tiles) {
@@ -11,6 +11,7 @@
 #include "../../includes.h"
 #include "../../common/dyn_array.h"
 #include "../../common/platform/mutex.h"
+#include "../../common/platform/thread.h"
 
 #include "../../common/vector.h"
 
@@ -39,21 +40,52 @@ struct render_tile {
 	bool network_renderer; //FIXME: client struct ptr
 	int index;
 	size_t total_samples;
-	size_t completed_samples;
+	size_t completed_samples; // Passes done in interactive mode, only accessed atomically there
 };
 
 typedef struct render_tile render_tile;
 dyn_array_def(render_tile)
 
+// Tiles are handed out by bumping an atomic cursor, so render threads never wait on each other
+// to get work. The mutex and condition are only used by threads that have to wait anyway.
 struct tile_set {
 	struct render_tile_arr tiles;
-	size_t finished;
+	// Tiles handed out so far, counting up through all passes in interactive mode.
+	// The top bits count restarts, so each tile handed out carries the generation it belongs to.
+	size_t next;
+	size_t waiting; // Threads blocked in tile_next_interactive()
 	struct cr_mutex *tile_mutex;
+	struct cr_cond *tile_done;
 };
 
-struct tile_set tile_quantize(unsigned width, unsigned height, unsigned tile_w, unsigned tile_h, enum render_order order);
+/// Splits the image into tiles, in the given render order
+/// @param threads Threads rendering the tiles. The tiles rendered last are split into smaller ones,
+///                so that this many threads stay busy until the end. 0 to keep all tiles the same size.
+struct tile_set tile_quantize(unsigned width, unsigned height, unsigned tile_w, unsigned tile_h, enum render_order order, size_t threads);
 void tile_set_free(struct tile_set *set);
 
+/// Tiles handed out so far, up to the tile count
+size_t tile_set_started(struct tile_set *set);
+
+/// Starts an interactive render over from the first pass. Tiles handed out before this are stale,
+/// threads waiting to render one give it up, and finishing one doesn't count.
+/// @remark Doesn't stop threads from writing out a stale tile, pause them for that
+void tile_set_restart(struct renderer *r, struct tile_set *set);
+
+/// Whether the render was restarted since tiles of the given generation were handed out, see tile_next_interactive()
+bool tile_set_restarted(struct tile_set *set, size_t generation);
+
+/// Wakes up the threads waiting in tile_next_interactive(), to check if the render was paused or stopped
+void tile_set_wake(struct tile_set *set);
+
 struct render_tile *tile_next(struct tile_set *set);
 
-struct render_tile *tile_next_interactive(struct renderer *r, struct tile_set *set);
+/// Hands out the next tile of an interactive render, along with the pass to render it for, starting from 1.
+/// Tiles are handed out pass after pass without waiting for the previous pass to finish.
+/// When all passes are done, this blocks until the render is restarted, paused or stopped.
+/// @param generation Set to the number of restarts the tile was handed out after, for tile_finish_interactive()
+/// @return The tile, or NULL if the render was paused or stopped
+struct render_tile *tile_next_interactive(struct renderer *r, struct tile_set *set, size_t *pass, size_t *generation);
+
+/// Marks a tile done for the pass it was handed out for, see tile_next_interactive()
+void tile_finish_interactive(struct renderer *r, struct tile_set *set, struct render_tile *tile, size_t pass, size_t generation);
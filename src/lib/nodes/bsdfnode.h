@@ -25,10 +25,18 @@ struct bsdfSample {
 	struct color emitted; // FIXME: Not really the right place for this
 };
 
-//TODO: Expand and refactor to match a standard bsdf signature with eval, sample and pdf
+// Directions given to eval and pdf point away from the surface, the view direction is the reverse of record->incident.
 struct bsdfNode {
 	struct nodeBase base;
 	struct bsdfSample (*sample)(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record);
+	// Reflected radiance towards the viewer for light arriving from `wi`, times the cosine term.
+	// Perfectly sharp reflections and refractions are left out of eval and pdf, sample() flags those rt_singular.
+	// Shaders without these can't be lit with next event estimation, and only get light by sampling.
+	struct color (*eval)(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi);
+	// Solid angle density of sample() picking `wi`. sample() weights are eval / pdf on average.
+	float (*pdf)(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi);
+	// Optional, set for shaders that emit light. Surfaces with these are added to the light list.
+	struct color (*emitted)(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record);
 };
 
 typedef const struct bsdfNode * bsdf_node_ptr;
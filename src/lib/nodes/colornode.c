@@ -14,10 +14,63 @@
 #include "../../common/string.h"
 #include "../datatypes/scene.h"
 #include "../../common/loaders/textureloader.h"
+#include "../../common/platform/thread_pool.h"
+#include "../../common/platform/signal.h"
+#include "../../common/logging.h"
 #include "bsdfnode.h"
 
 #include "colornode.h"
 
+struct texture_load {
+	char *path;
+	file_data data;
+	struct texture *tex;
+};
+
+static void texture_load_task(void *arg) {
+	block_signals();
+	struct texture_load *load = arg;
+	struct texture *decoded = load_texture(load->path, load->data);
+	if (decoded) {
+		// Nodes already point to the placeholder, so move the result in there
+		*load->tex = *decoded;
+		free(decoded);
+	} else {
+		// The header looked fine, so this should be rare. Leave a black pixel instead of nothing.
+		struct texture *black = newTexture(char_p, 1, 1, 3);
+		*load->tex = *black;
+		free(black);
+	}
+	file_free(&load->data);
+	free(load->path);
+	free(load);
+}
+
+// Decodes the texture on the scene's pool if it has one. The returned texture is
+// only filled in once the scene's texture_loads group is done.
+static struct texture *start_texture_load(struct world *scene, const char *path, file_data data) {
+	if (!scene->pool) {
+		struct texture *tex = load_texture(path, data);
+		file_free(&data);
+		return tex;
+	}
+	if (!texture_can_decode(path, data)) {
+		logr(warning, "Can't decode texture \"%s\"\n", path);
+		file_free(&data);
+		return NULL;
+	}
+	struct texture_load *load = malloc(sizeof(*load));
+	*load = (struct texture_load){
+		.path = stringCopy(path),
+		.data = data,
+		.tex = newTexture(none, 0, 0, 0)
+	};
+	struct texture *tex = load->tex;
+	if (!thread_pool_enqueue_group(scene->pool, &scene->texture_loads, texture_load_task, load))
+		texture_load_task(load);
+	return tex;
+}
+
 // const struct colorNode *unknownTextureNode(const struct node_storage *s) {
 // 	return newConstantTexture(s, g_black_color);
 // }
@@ -44,7 +97,6 @@ const struct colorNode *build_color_node(struct cr_scene *s_ext, const struct cr
 				windowsFixPath(full);
 			}
 			const char *path = full ? full : desc->arg.image.full_path;
-			file_data data = file_load(path);
 			struct texture *tex = NULL;
 			// Note: We also deduplicate texture loads here, which ideally shouldn't be necessary.
 			for (size_t i = 0; i < scene->textures.count; ++i) {
@@ -53,13 +105,12 @@ const struct colorNode *build_color_node(struct cr_scene *s_ext, const struct cr
 				}
 			}
 			if (!tex) {
-				tex = load_texture(path, data);
+				tex = start_texture_load(scene, path, file_load(path));
 				texture_asset_arr_add(&scene->textures, (struct texture_asset){
 					.path = stringCopy(path),
 					.t = tex
 				});
 			}
-			file_free(&data);
 			const struct colorNode *new = newImageTexture(&s, tex, desc->arg.image.options);
 			if (full) free(full);
 			return new;
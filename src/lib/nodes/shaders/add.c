@@ -46,18 +46,51 @@ static void dump(const void *node, char *dumpbuf, int bufsize) {
 	snprintf(dumpbuf, bufsize, "addBsdf { A: %s, B: %s }", A, B);
 }
 
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct addBsdf *addBsdf = (struct addBsdf *)bsdf;
+	const struct color A = addBsdf->A->eval(addBsdf->A, sampler, record, wi);
+	const struct color B = addBsdf->B->eval(addBsdf->B, sampler, record, wi);
+	return colorAdd(A, B);
+}
+
+// sample() picks either side evenly
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct addBsdf *addBsdf = (struct addBsdf *)bsdf;
+	const float A = addBsdf->A->pdf(addBsdf->A, sampler, record, wi);
+	const float B = addBsdf->B->pdf(addBsdf->B, sampler, record, wi);
+	return 0.5f * (A + B);
+}
+
+static struct color emitted(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+	struct addBsdf *addBsdf = (struct addBsdf *)bsdf;
+	const struct color A = addBsdf->A->emitted ? addBsdf->A->emitted(addBsdf->A, sampler, record) : g_black_color;
+	const struct color B = addBsdf->B->emitted ? addBsdf->B->emitted(addBsdf->B, sampler, record) : g_black_color;
+	return colorAdd(A, B);
+}
+
 static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
-	struct addBsdf *mixBsdf = (struct addBsdf *)bsdf;
-	struct bsdfSample A = mixBsdf->A->sample(mixBsdf->A, sampler, record);
-	struct bsdfSample B = mixBsdf->B->sample(mixBsdf->B, sampler, record);
-	// TODO: Do we just add the outgoing vertices together or what...?
-	// TODO: Find out if we want to even keep this node around.
-	// FIXME: Hackery. We're using B.out here, so our fake Principled Shader graph works
-	// as expected. This will be resolved once this shader system is rewritten to be correct,
-	// we're not supposed to compute the out direction here.
-	// Cycles does the add with OSL shading closures, instead of at this stage, so we'd have to
-	// do something similar to that, probably.
-	return (struct bsdfSample){.out = B.out, .weight = colorAdd(A.weight, B.weight)};
+	struct addBsdf *addBsdf = (struct addBsdf *)bsdf;
+	if (!bsdf->eval || !bsdf->pdf) {
+		struct bsdfSample A = addBsdf->A->sample(addBsdf->A, sampler, record);
+		struct bsdfSample B = addBsdf->B->sample(addBsdf->B, sampler, record);
+		// FIXME: Hackery. Without eval, there is no way to tell how much A scatters towards B.out,
+		// so A's weight just gets added on top. Our fake Principled Shader graph has eval on both
+		// sides, so it doesn't end up here.
+		return (struct bsdfSample){.out = B.out, .weight = colorAdd(A.weight, B.weight), .emitted = colorAdd(A.emitted, B.emitted)};
+	}
+	// Follow either side, and weigh the direction by both. Sharp samples only come from the side
+	// that picked them, so those just make up for being picked half the time.
+	const struct bsdfNode *picked = getDimension(sampler) < 0.5f ? addBsdf->A : addBsdf->B;
+	struct bsdfSample sample = picked->sample(picked, sampler, record);
+	sample.emitted = emitted(bsdf, sampler, record);
+	if (sample.out.type & rt_singular) {
+		sample.weight = colorCoef(2.0f, sample.weight);
+		return sample;
+	}
+	const struct vector wi = vec_normalize(sample.out.direction);
+	const float density = pdf(bsdf, sampler, record, wi);
+	sample.weight = density > 0.0f ? colorCoef(1.0f / density, eval(bsdf, sampler, record, wi)) : g_black_color;
+	return sample;
 }
 
 const struct bsdfNode *newAdd(const struct node_storage *s, const struct bsdfNode *A, const struct bsdfNode *B) {
@@ -70,6 +103,9 @@ const struct bsdfNode *newAdd(const struct node_storage *s, const struct bsdfNod
 		.B = B ? B : newDiffuse(s, newConstantTexture(s, g_black_color)),
 		.bsdf = {
 			.sample = sample,
+			.eval = (!A || A->eval) && (!B || B->eval) ? eval : NULL,
+			.pdf = (!A || A->pdf) && (!B || B->pdf) ? pdf : NULL,
+			.emitted = (A && A->emitted) || (B && B->emitted) ? emitted : NULL,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -53,11 +53,27 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	};
 }
 
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct diffuseBsdf *diffBsdf = (struct diffuseBsdf *)bsdf;
+	const float cos_theta = vec_dot(record->surfaceNormal, wi);
+	if (cos_theta <= 0.0f) return g_black_color;
+	return colorCoef(cos_theta / PI, diffBsdf->color->eval(diffBsdf->color, sampler, record));
+}
+
+// sample() is cosine weighted
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	return max(vec_dot(record->surfaceNormal, wi), 0.0f) / PI;
+}
+
 const struct bsdfNode *newDiffuse(const struct node_storage *s, const struct colorNode *color) {
 	HASH_CONS(s->node_table, hash, struct diffuseBsdf, {
 		.color = color ? color : newConstantTexture(s, g_black_color),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -48,21 +48,43 @@ static void dump(const void *node, char *dumpbuf, int bufsize) {
 	snprintf(dumpbuf, bufsize, "emissiveBsdf { color: %s, strength: %s }", color, strength);
 }
 
-static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+static struct color emitted(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
 	struct emissiveBsdf *emitBsdf = (struct emissiveBsdf *)bsdf;
+	return colorCoef(emitBsdf->strength->eval(emitBsdf->strength, sampler, record), emitBsdf->color->eval(emitBsdf->color, sampler, record));
+}
+
+static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
 	const struct vector scatterDir = vec_normalize(vec_add(record->surfaceNormal, vec_on_unit_sphere(sampler)));
 	return (struct bsdfSample){
 		.out = { .start = record->hitPoint, .direction = scatterDir, .type = rt_reflection | rt_diffuse },
-		.emitted = colorCoef(emitBsdf->strength->eval(emitBsdf->strength, sampler, record), emitBsdf->color->eval(emitBsdf->color, sampler, record))
+		.emitted = emitted(bsdf, sampler, record)
 	};
 }
 
+// Emitters don't reflect anything, but mixes with them still need to know where sample() goes
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	(void)record;
+	(void)wi;
+	return g_black_color;
+}
+
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	return max(vec_dot(record->surfaceNormal, wi), 0.0f) / PI;
+}
+
 const struct bsdfNode *newEmission(const struct node_storage *s, const struct colorNode *color, const struct valueNode *strength) {
 	HASH_CONS(s->node_table, hash, struct emissiveBsdf, {
 		.color = color ? color : newConstantTexture(s, g_black_color),
 		.strength = strength ? strength : newConstantValue(s, 1.0f),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
+			.emitted = emitted,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -49,14 +49,17 @@ static void dump(const void *node, char *dumpbuf, int bufsize) {
 	snprintf(dumpbuf, bufsize, "glassBsdf { color: %s, roughness: %s, IOR: %s }", color, roughness, IOR);
 }
 
-static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
-	struct glassBsdf *glassBsdf = (struct glassBsdf *)bsdf;
-	
-	struct vector outwardNormal;
-	struct vector reflected = vec_reflect(record->incident->direction, record->surfaceNormal);
-	float niOverNt;
+// The smooth reflection and refraction directions, and how often sample() picks the reflection
+struct glassLobes {
+	struct vector reflected;
 	struct vector refracted;
 	float reflectionProbability;
+};
+
+static struct glassLobes glass_lobes(const struct glassBsdf *glassBsdf, sampler *sampler, const struct hitRecord *record) {
+	struct vector outwardNormal;
+	struct glassLobes lobes = { .reflected = vec_reflect(record->incident->direction, record->surfaceNormal) };
+	float niOverNt;
 	float cosine;
 	
 	float IOR = glassBsdf->IOR->eval(glassBsdf->IOR, sampler, record);
@@ -71,25 +74,31 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 		cosine = -(vec_dot(record->incident->direction, record->surfaceNormal) / vec_length(record->incident->direction));
 	}
 	
-	if (vec_refract(record->incident->direction, outwardNormal, niOverNt, &refracted)) {
-		reflectionProbability = schlick(cosine, IOR);
+	if (vec_refract(record->incident->direction, outwardNormal, niOverNt, &lobes.refracted)) {
+		lobes.reflectionProbability = schlick(cosine, IOR);
 	} else {
-		reflectionProbability = 1.0f;
+		lobes.reflectionProbability = 1.0f;
 	}
+	return lobes;
+}
+
+static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+	struct glassBsdf *glassBsdf = (struct glassBsdf *)bsdf;
+	struct glassLobes lobes = glass_lobes(glassBsdf, sampler, record);
 	
 	float roughness = glassBsdf->roughness->eval(glassBsdf->roughness, sampler, record);
 	if (roughness > 0.0f) {
 		struct vector fuzz = vec_scale(vec_on_unit_sphere(sampler), roughness);
-		reflected = vec_add(reflected, fuzz);
-		refracted = vec_add(refracted, fuzz);
+		lobes.reflected = vec_add(lobes.reflected, fuzz);
+		lobes.refracted = vec_add(lobes.refracted, fuzz);
 	}
 	
 	struct lightRay out = { .start = record->hitPoint };
-	if (getDimension(sampler) < reflectionProbability) {
-		out.direction = reflected;
+	if (getDimension(sampler) < lobes.reflectionProbability) {
+		out.direction = lobes.reflected;
 		out.type = rt_reflection | (roughness == 0.0f ? rt_singular : rt_glossy);
 	} else {
-		out.direction = refracted;
+		out.direction = lobes.refracted;
 		out.type = rt_transmission | (roughness == 0.0f ? rt_singular : rt_glossy);
 	}
 	
@@ -99,6 +108,23 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	};
 }
 
+// Smooth glass only has the two directions sample() picks, which eval and pdf leave out
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct glassBsdf *glassBsdf = (struct glassBsdf *)bsdf;
+	const float roughness = glassBsdf->roughness->eval(glassBsdf->roughness, sampler, record);
+	if (roughness <= 0.0f) return 0.0f;
+	const struct glassLobes lobes = glass_lobes(glassBsdf, sampler, record);
+	float pdf = lobes.reflectionProbability * pdf_on_sphere_around(lobes.reflected, roughness, wi);
+	if (lobes.reflectionProbability < 1.0f)
+		pdf += (1.0f - lobes.reflectionProbability) * pdf_on_sphere_around(lobes.refracted, roughness, wi);
+	return pdf;
+}
+
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct glassBsdf *glassBsdf = (struct glassBsdf *)bsdf;
+	return colorCoef(pdf(bsdf, sampler, record, wi), glassBsdf->color->eval(glassBsdf->color, sampler, record));
+}
+
 const struct bsdfNode *newGlass(const struct node_storage *s, const struct colorNode *color, const struct valueNode *roughness, const struct valueNode *IOR) {
 	HASH_CONS(s->node_table, hash, struct glassBsdf, {
 		.color = color ? color : newConstantTexture(s, g_black_color),
@@ -106,6 +132,8 @@ const struct bsdfNode *newGlass(const struct node_storage *s, const struct color
 		.IOR = IOR ? IOR : newConstantValue(s, 1.45f),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -53,11 +53,28 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	};
 }
 
+// sample() picks any direction, so the color gets spread evenly over the sphere
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)wi;
+	struct isotropicBsdf *isoBsdf = (struct isotropicBsdf *)bsdf;
+	return colorCoef(1.0f / (4.0f * PI), isoBsdf->color->eval(isoBsdf->color, sampler, record));
+}
+
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	(void)record;
+	(void)wi;
+	return 1.0f / (4.0f * PI);
+}
+
 const struct bsdfNode *newIsotropic(const struct node_storage *s, const struct colorNode *color) {
 	HASH_CONS(s->node_table, hash, struct isotropicBsdf, {
 		.color = color ? color : newConstantTexture(s, g_black_color),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
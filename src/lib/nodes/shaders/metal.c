@@ -63,12 +63,28 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	};
 }
 
+// A perfect mirror only reflects in the one direction sample() picks, which eval and pdf leave out
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct metalBsdf *metalBsdf = (struct metalBsdf *)bsdf;
+	const float roughness = metalBsdf->roughness->eval(metalBsdf->roughness, sampler, record);
+	if (roughness <= 0.0f) return 0.0f;
+	const struct vector reflected = vec_reflect(vec_normalize(record->incident->direction), record->surfaceNormal);
+	return pdf_on_sphere_around(reflected, roughness, wi);
+}
+
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct metalBsdf *metalBsdf = (struct metalBsdf *)bsdf;
+	return colorCoef(pdf(bsdf, sampler, record, wi), metalBsdf->color->eval(metalBsdf->color, sampler, record));
+}
+
 const struct bsdfNode *newMetal(const struct node_storage *s, const struct colorNode *color, const struct valueNode *roughness) {
 	HASH_CONS(s->node_table, hash, struct metalBsdf, {
 		.color = color ? color : newConstantTexture(s, g_black_color),
 		.roughness = roughness ? roughness : newConstantValue(s, 0.0f),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
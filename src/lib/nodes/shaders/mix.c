@@ -59,6 +59,31 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	}
 }
 
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct mixBsdf *mixBsdf = (struct mixBsdf *)bsdf;
+	const float lerp = mixBsdf->factor->eval(mixBsdf->factor, sampler, record);
+	const struct color A = mixBsdf->A->eval(mixBsdf->A, sampler, record, wi);
+	const struct color B = mixBsdf->B->eval(mixBsdf->B, sampler, record, wi);
+	return colorAdd(colorCoef(1.0f - lerp, A), colorCoef(lerp, B));
+}
+
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct mixBsdf *mixBsdf = (struct mixBsdf *)bsdf;
+	const float lerp = mixBsdf->factor->eval(mixBsdf->factor, sampler, record);
+	const float A = mixBsdf->A->pdf(mixBsdf->A, sampler, record, wi);
+	const float B = mixBsdf->B->pdf(mixBsdf->B, sampler, record, wi);
+	return (1.0f - lerp) * A + lerp * B;
+}
+
+// Only set for mixes with an emissive side. sample() picks A with 1 - lerp, so that's how much of it shows.
+static struct color emitted(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+	struct mixBsdf *mixBsdf = (struct mixBsdf *)bsdf;
+	const float lerp = mixBsdf->factor->eval(mixBsdf->factor, sampler, record);
+	const struct color A = mixBsdf->A->emitted ? mixBsdf->A->emitted(mixBsdf->A, sampler, record) : g_black_color;
+	const struct color B = mixBsdf->B->emitted ? mixBsdf->B->emitted(mixBsdf->B, sampler, record) : g_black_color;
+	return colorAdd(colorCoef(1.0f - lerp, A), colorCoef(lerp, B));
+}
+
 const struct bsdfNode *newMix(const struct node_storage *s, const struct bsdfNode *A, const struct bsdfNode *B, const struct valueNode *factor) {
 	if (A == B) {
 		logr(debug, "A == B, pruning mix node.\n");
@@ -70,6 +95,9 @@ const struct bsdfNode *newMix(const struct node_storage *s, const struct bsdfNod
 		.factor = factor ? factor : newConstantValue(s, 0.5f),
 		.bsdf = {
 			.sample = sample,
+			.eval = (!A || A->eval) && (!B || B->eval) ? eval : NULL,
+			.pdf = (!A || A->pdf) && (!B || B->pdf) ? pdf : NULL,
+			.emitted = (A && A->emitted) || (B && B->emitted) ? emitted : NULL,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -71,15 +71,13 @@ static struct bsdfSample sampleShiny(const struct bsdfNode *bsdf, sampler *sampl
 	};
 }
 
-static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+// How often sample() picks the clear coat over the diffuse base
+static float reflection_probability(const struct plasticBsdf *this, sampler *sampler, const struct hitRecord *record) {
 	struct vector outwardNormal;
 	float niOverNt;
 	struct vector refracted;
-	float reflectionProbability;
 	float cosine;
 	
-	struct plasticBsdf *this = (struct plasticBsdf *)bsdf;
-	
 	const float IOR = this->IOR->eval(this->IOR, sampler, record);
 	
 	if (vec_dot(record->incident->direction, record->surfaceNormal) > 0.0f) {
@@ -93,11 +91,15 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	}
 	
 	if (vec_refract(record->incident->direction, outwardNormal, niOverNt, &refracted)) {
-		reflectionProbability = schlick(cosine, IOR);
+		return schlick(cosine, IOR);
 	} else {
-		reflectionProbability = 1.0f;
+		return 1.0f;
 	}
-	
+}
+
+static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record) {
+	struct plasticBsdf *this = (struct plasticBsdf *)bsdf;
+	const float reflectionProbability = reflection_probability(this, sampler, record);
 	if (getDimension(sampler) < reflectionProbability) {
 		return sampleShiny(bsdf, sampler, record);
 	} else {
@@ -105,6 +107,30 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	}
 }
 
+// Density of the clear coat picking wi, 0 for a smooth one, which eval and pdf leave out
+static float pdfShiny(const struct plasticBsdf *plastic, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	const float roughness = plastic->roughness->eval(plastic->roughness, sampler, record);
+	if (roughness <= 0.0f) return 0.0f;
+	return pdf_on_sphere_around(vec_reflect(record->incident->direction, record->surfaceNormal), roughness, wi);
+}
+
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct plasticBsdf *this = (struct plasticBsdf *)bsdf;
+	const float reflectionProbability = reflection_probability(this, sampler, record);
+	const float shiny = pdfShiny(this, sampler, record, wi);
+	const float diffuse = this->diffuse->pdf(this->diffuse, sampler, record, wi);
+	return reflectionProbability * shiny + (1.0f - reflectionProbability) * diffuse;
+}
+
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	struct plasticBsdf *this = (struct plasticBsdf *)bsdf;
+	const float reflectionProbability = reflection_probability(this, sampler, record);
+	const float shiny = pdfShiny(this, sampler, record, wi);
+	const struct color coat = colorCoef(reflectionProbability * shiny, this->clear_coat->eval(this->clear_coat, sampler, record));
+	const struct color diffuse = colorCoef(1.0f - reflectionProbability, this->diffuse->eval(this->diffuse, sampler, record, wi));
+	return colorAdd(coat, diffuse);
+}
+
 // TODO: Separate clear coat + base colors
 const struct bsdfNode *newPlastic(const struct node_storage *s, const struct colorNode *color, const struct valueNode *roughness, const struct valueNode *IOR) {
 	HASH_CONS(s->node_table, hash, struct plasticBsdf, {
@@ -114,6 +140,8 @@ const struct bsdfNode *newPlastic(const struct node_storage *s, const struct col
 		.IOR = IOR ? IOR : newConstantValue(s, 1.45f),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
@@ -52,11 +52,30 @@ static struct bsdfSample sample(const struct bsdfNode *bsdf, sampler *sampler, c
 	};
 }
 
+// Light only passes straight through, sample() is the only way to find it
+static struct color eval(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	(void)record;
+	(void)wi;
+	return g_black_color;
+}
+
+static float pdf(const struct bsdfNode *bsdf, sampler *sampler, const struct hitRecord *record, struct vector wi) {
+	(void)bsdf;
+	(void)sampler;
+	(void)record;
+	(void)wi;
+	return 0.0f;
+}
+
 const struct bsdfNode *newTransparent(const struct node_storage *s, const struct colorNode *color) {
 	HASH_CONS(s->node_table, hash, struct transparent, {
 		.color = color ? color : newConstantTexture(s, g_white_color),
 		.bsdf = {
 			.sample = sample,
+			.eval = eval,
+			.pdf = pdf,
 			.base = { .compare = compare, .dump = dump }
 		}
 	});
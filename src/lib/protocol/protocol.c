@@ -26,6 +26,8 @@
 #include "../../common/base64.h"
 #include "../../common/timer.h"
 #include "../../common/node_parse.h"
+#include "../../common/platform/thread_pool.h"
+#include "../../common/platform/capabilities.h"
 #include "../renderer/renderer.h"
 #include "../renderer/instance.h"
 #include "../datatypes/tile.h"
@@ -343,6 +345,7 @@ static cJSON *serialize_mesh(const struct mesh in) {
 	cJSON *out = cJSON_CreateObject();
 	cJSON_AddItemToObject(out, "polygons", serialize_faces(in.polygons));
 	cJSON_AddNumberToObject(out, "vbuf_idx", in.vbuf_idx);
+	cJSON_AddNumberToObject(out, "spatial_split_budget", in.spatial_split_budget);
 	// TODO: name
 	return out;
 }
@@ -353,6 +356,8 @@ static struct mesh deserialize_mesh(const cJSON *in) {
 
 	out.polygons = deserialize_faces(cJSON_GetObjectItem(in, "polygons"));
 	out.vbuf_idx = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "vbuf_idx"));
+	const cJSON *spatial_split_budget = cJSON_GetObjectItem(in, "spatial_split_budget");
+	if (cJSON_IsNumber(spatial_split_budget)) out.spatial_split_budget = spatial_split_budget->valuedouble;
 
 	return out;
 }
@@ -372,12 +377,48 @@ static sphere deserialize_sphere(const cJSON *in) {
 	return out;
 }
 
+static cJSON *serialize_sphere_set(const struct sphere_set in) {
+	cJSON *out = cJSON_CreateObject();
+	cJSON_AddNumberToObject(out, "count", in.centers.count);
+	if (in.centers.count) {
+		char *data = b64encode(in.centers.items, in.centers.count * sizeof(*in.centers.items));
+		cJSON_AddStringToObject(out, "centers", data);
+		free(data);
+		data = b64encode(in.radii.items, in.radii.count * sizeof(*in.radii.items));
+		cJSON_AddStringToObject(out, "radii", data);
+		free(data);
+	}
+	return out;
+}
+
+static struct sphere_set deserialize_sphere_set(const cJSON *in) {
+	struct sphere_set out = { 0 };
+	if (!in) return out;
+	size_t count = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "count"));
+	char *c_b64 = cJSON_GetStringValue(cJSON_GetObjectItem(in, "centers"));
+	char *r_b64 = cJSON_GetStringValue(cJSON_GetObjectItem(in, "radii"));
+	if (!c_b64 || !r_b64 || !count) return out;
+	size_t out_bytes = 0;
+	struct vector *centers = b64decode(c_b64, strlen(c_b64), &out_bytes);
+	ASSERT(out_bytes == count * sizeof(struct vector));
+	float *radii = b64decode(r_b64, strlen(r_b64), &out_bytes);
+	ASSERT(out_bytes == count * sizeof(float));
+	for (size_t i = 0; i < count; ++i) {
+		vector_arr_add(&out.centers, centers[i]);
+		float_arr_add(&out.radii, radii[i]);
+	}
+	free(centers);
+	free(radii);
+	return out;
+}
+
 static cJSON *serialize_instance(const struct instance in) {
 	cJSON *out = cJSON_CreateObject();
 	cJSON_AddItemToObject(out, "composite", serialize_transform(in.composite));
 	cJSON_AddNumberToObject(out, "object_idx", in.object_idx);
 	cJSON_AddNumberToObject(out, "bbuf_idx", in.bbuf_idx);
 	cJSON_AddBoolToObject(out, "is_mesh", isMesh(&in));
+	cJSON_AddBoolToObject(out, "is_sphere_set", isSphereSet(&in));
 	return out;
 }
 
@@ -385,15 +426,18 @@ static struct instance deserialize_instance(const cJSON *in) {
 	if (!in) return (struct instance){ 0 };
 	size_t object_idx = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "object_idx"));
 	bool is_mesh = cJSON_IsTrue(cJSON_GetObjectItem(in, "is_mesh"));
+	bool is_sphere_set = cJSON_IsTrue(cJSON_GetObjectItem(in, "is_sphere_set"));
 
 	struct instance out = { 0 };
 	if (is_mesh) {
 		out = new_mesh_instance(NULL, object_idx, NULL, NULL);
+	} else if (is_sphere_set) {
+		out = new_sphere_set_instance(NULL, object_idx);
 	} else {
 		out = new_sphere_instance(NULL, object_idx, NULL, NULL);
 	}
 
-	out.composite = deserialize_transform(cJSON_GetObjectItem(in, "composite"));
+	instance_set_transform(&out, deserialize_transform(cJSON_GetObjectItem(in, "composite")));
 	out.bbuf_idx = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "bbuf_idx"));
 
 	return out;
@@ -746,6 +790,12 @@ static cJSON *serialize_scene(const struct world *in) {
 	}
 	cJSON_AddItemToObject(out, "spheres", spheres);
 
+	cJSON *sphere_sets = cJSON_CreateArray();
+	for (size_t i = 0; i < in->sphere_sets.count; ++i) {
+		cJSON_AddItemToArray(sphere_sets, serialize_sphere_set(in->sphere_sets.items[i]));
+	}
+	cJSON_AddItemToObject(out, "sphere_sets", sphere_sets);
+
 	cJSON *instances = cJSON_CreateArray();
 	for (size_t i = 0; i < in->instances.count; ++i) {
 		cJSON_AddItemToArray(instances, serialize_instance(in->instances.items[i]));
@@ -835,6 +885,13 @@ struct world *deserialize_scene(const cJSON *in) {
 			sphere_arr_add(&out->spheres, deserialize_sphere(sphere));
 		}
 	}
+	cJSON *sphere_sets = cJSON_GetObjectItem(in, "sphere_sets");
+	if (cJSON_IsArray(sphere_sets)) {
+		cJSON *sphere_set = NULL;
+		cJSON_ArrayForEach(sphere_set, sphere_sets) {
+			sphere_set_arr_add(&out->sphere_sets, deserialize_sphere_set(sphere_set));
+		}
+	}
 	cJSON *instances = cJSON_GetObjectItem(in, "instances");
 	if (cJSON_IsArray(instances)) {
 		cJSON *instance = NULL;
@@ -849,6 +906,8 @@ struct world *deserialize_scene(const cJSON *in) {
 		inst->bbuf = &out->shader_buffers.items[inst->bbuf_idx];
 		if (isMesh(inst)) {
 			inst->object_arr = &out->meshes;
+		} else if (isSphereSet(inst)) {
+			inst->object_arr = &out->sphere_sets;
 		} else {
 			inst->object_arr = &out->spheres;
 		}
@@ -878,6 +937,12 @@ static cJSON *serialize_prefs(const struct prefs in) {
 	cJSON_AddItemToObject(out, "width", cJSON_CreateNumber(in.override_width));
 	cJSON_AddItemToObject(out, "height", cJSON_CreateNumber(in.override_height));
 	cJSON_AddItemToObject(out, "selected_camera", cJSON_CreateNumber(in.selected_camera));
+	cJSON_AddItemToObject(out, "spatialSplits", cJSON_CreateBool(in.bvh_params.spatial_splits));
+	cJSON_AddItemToObject(out, "bvhLayout", cJSON_CreateNumber(in.bvh_params.layout));
+	cJSON_AddItemToObject(out, "bvhBuilder", cJSON_CreateNumber(in.bvh_params.builder));
+	cJSON_AddItemToObject(out, "flattenScene", cJSON_CreateBool(in.flatten_scene));
+	cJSON_AddItemToObject(out, "noiseThreshold", cJSON_CreateNumber(in.noise_threshold));
+	cJSON_AddItemToObject(out, "sampler", cJSON_CreateNumber(in.sampler));
 	return out;
 }
 
@@ -897,11 +962,21 @@ struct prefs deserialize_prefs(const cJSON *in) {
 	p.override_width = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "width"));
 	p.override_height = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "height"));
 	p.selected_camera = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "selected_camera"));
+	p.bvh_params.spatial_splits = cJSON_IsTrue(cJSON_GetObjectItem(in, "spatialSplits"));
+	p.bvh_params.layout = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "bvhLayout"));
+	p.bvh_params.builder = cJSON_GetNumberValue(cJSON_GetObjectItem(in, "bvhBuilder"));
+	p.flatten_scene = cJSON_IsTrue(cJSON_GetObjectItem(in, "flattenScene"));
+	const cJSON *noise_threshold = cJSON_GetObjectItem(in, "noiseThreshold");
+	p.noise_threshold = cJSON_IsNumber(noise_threshold) ? noise_threshold->valuedouble : 0.0f;
+	const cJSON *sampler = cJSON_GetObjectItem(in, "sampler");
+	if (cJSON_IsNumber(sampler)) p.sampler = sampler->valueint;
 	return p;
 }
 
 static cJSON *serialize_json(const struct renderer *r) {
 	if (!r) return NULL;
+	// Textures get serialized too, so they have to be decoded first
+	thread_pool_wait_group(r->scene->pool, &r->scene->texture_loads);
 	cJSON *out = cJSON_CreateObject();
 	cJSON_AddItemToObject(out, "scene", serialize_scene(r->scene));
 	cJSON_AddItemToObject(out, "prefs", serialize_prefs(r->prefs));
@@ -928,6 +1003,7 @@ struct renderer *deserialize_renderer(const char *data) {
 	if (!renderer) return NULL;
 	struct renderer *r = calloc(1, sizeof(*r));
 	r->state.finishedPasses = 1;
+	r->state.pool = thread_pool_create(sys_get_cores());
 	r->scene = deserialize_scene(cJSON_GetObjectItem(renderer, "scene"));
 	r->prefs = deserialize_prefs(cJSON_GetObjectItem(renderer, "prefs"));
 	cJSON_Delete(renderer);
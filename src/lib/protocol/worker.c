@@ -56,6 +56,7 @@ struct workerThreadState {
 	size_t completedSamples;
 	long avgSampleTime;
 	struct render_tile *current;
+	struct render_tile tile; // Where current points to. The master may split tiles, so they don't map to ours.
 	struct tile_set *tiles;
 };
 
@@ -83,7 +84,7 @@ static cJSON *receiveScene(const cJSON *json) {
 }
 
 // Tilenum of -1 communicates that it failed to get work, signaling the work thread to exit
-static struct render_tile *getWork(int connectionSocket, struct tile_set *tiles) {
+static struct render_tile *getWork(int connectionSocket, struct render_tile *out) {
 	if (!sendJSON(connectionSocket, newAction("getWork"), NULL)) {
 		return NULL;
 	}
@@ -101,10 +102,9 @@ static struct render_tile *getWork(int connectionSocket, struct tile_set *tiles)
 	// In fact, this whole tile object thing might be a bit pointless, since
 	// we can just keep track of indices, and compute the tile dims
 	cJSON *tileJson = cJSON_GetObjectItem(response, "tile");
-	struct render_tile tile = decodeTile(tileJson);
-	tiles->tiles.items[tile.index] = tile;
+	*out = decodeTile(tileJson);
 	cJSON_Delete(response);
-	return &tiles->tiles.items[tile.index];
+	return out;
 }
 
 static bool submitWork(int sock, struct texture *work, struct render_tile *forTile) {
@@ -125,7 +125,7 @@ static void *workerThread(void *arg) {
 	
 	//Fetch initial task
 	mutex_lock(sockMutex);
-	thread->current = getWork(sock, thread->tiles);
+	thread->current = getWork(sock, &thread->tile);
 	mutex_release(sockMutex);
 	sampler *sampler = newSampler();
 
@@ -149,7 +149,7 @@ static void *workerThread(void *arg) {
 				for (int x = thread->current->begin.x; x < thread->current->end.x; ++x) {
 					if (r->state.render_aborted || !g_running) goto bail;
 					uint32_t pixIdx = (uint32_t)(y * cam->width + x);
-					initSampler(sampler, SAMPLING_STRATEGY, thread->completedSamples - 1, r->prefs.sampleCount, pixIdx);
+					initSampler(sampler, r->prefs.sampler, thread->completedSamples - 1, r->prefs.sampleCount, pixIdx);
 					
 					int local_x = x - thread->current->begin.x;
 					int local_y = y - thread->current->begin.y;
@@ -191,7 +191,7 @@ static void *workerThread(void *arg) {
 		mutex_release(sockMutex);
 		thread->completedSamples = 1;
 		mutex_lock(sockMutex);
-		thread->current = getWork(sock, thread->tiles);
+		thread->current = getWork(sock, &thread->tile);
 		mutex_release(sockMutex);
 		tex_clear(tileBuffer);
 	}
@@ -228,18 +228,26 @@ static cJSON *startRender(int connectionSocket, size_t thread_limit) {
 		KNRM,
 		PLURAL(r->prefs.threads));
 	//Quantize image into renderTiles
-	struct tile_set set = tile_quantize(selected_cam.width, selected_cam.height, r->prefs.tileWidth, r->prefs.tileHeight, r->prefs.tileOrder);
+	struct tile_set set = tile_quantize(selected_cam.width, selected_cam.height, r->prefs.tileWidth, r->prefs.tileHeight, r->prefs.tileOrder, 0);
 
 	logr(info, "%u x %u tiles\n", r->prefs.tileWidth, r->prefs.tileHeight);
 	// Do some pre-render preparations
 	// Compute BVH acceleration structures for all meshes in the scene
-	compute_accels(r->scene->meshes);
+	compute_accels(r->state.pool, r->scene->meshes, r->prefs.bvh_params);
+	compute_sphere_set_accels(r->state.pool, r->scene->sphere_sets, r->prefs.bvh_params);
+	light_list_build(&r->scene->lights, r->scene);
+	destroy_flat_scene(r->scene->flat);
+	r->scene->flat = r->prefs.flatten_scene ? flatten_scene(r->scene) : NULL;
+	if (r->scene->flat) {
+		logr(info, "Flattened %zu instances into one mesh\n", r->scene->flat->merged_count);
+		compute_accels(r->state.pool, r->scene->flat->meshes, r->prefs.bvh_params);
+	}
 
 	// And then compute a single top-level BVH that contains all the objects
 	logr(info, "Computing top-level BVH: ");
 	struct timeval timer = {0};
 	timer_start(&timer);
-	r->scene->topLevel = build_top_level_bvh(r->scene->instances);
+	r->scene->topLevel = build_top_level_bvh(scene_traced_instances(r->scene), r->prefs.bvh_params.builder, r->state.pool);
 	printSmartTime(timer_get_ms(timer));
 	logr(plain, "\n");
 
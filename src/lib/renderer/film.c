@@ -0,0 +1,72 @@
+//
+//  film.c
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../includes.h"
+#include "film.h"
+
+#include "../../common/texture.h"
+#include <string.h>
+#include <math.h>
+
+void film_reset(struct film *film, unsigned width, unsigned height) {
+	const size_t count = (size_t)width * height;
+	if (count > film->capacity) {
+		film_free(film);
+		film->sums = malloc(count * sizeof(*film->sums));
+		film->odd_sums = malloc(count * sizeof(*film->odd_sums));
+		film->counts = malloc(count * sizeof(*film->counts));
+		film->converged = malloc(count * sizeof(*film->converged));
+		film->capacity = count;
+	}
+	film->width = width;
+	film->height = height;
+	memset(film->sums, 0, count * sizeof(*film->sums));
+	memset(film->odd_sums, 0, count * sizeof(*film->odd_sums));
+	memset(film->counts, 0, count * sizeof(*film->counts));
+	memset(film->converged, 0, count * sizeof(*film->converged));
+}
+
+// Difference between the full average and the average of the odd samples,
+// relative to the square root of the brightness, so dark pixels need to be less noisy.
+static float pixel_error(const struct film *film, size_t idx) {
+	const uint32_t count = film->counts[idx];
+	if (count < 2) return INFINITY;
+	const struct color all = colorCoef(1.0f / count, film->sums[idx]);
+	const struct color odd = colorCoef(1.0f / (count / 2), film->odd_sums[idx]);
+	const float diff = fabsf(all.red - odd.red) + fabsf(all.green - odd.green) + fabsf(all.blue - odd.blue);
+	return diff / sqrtf(1e-4f + all.red + all.green + all.blue);
+}
+
+size_t film_update_convergence(struct film *film, float threshold) {
+	size_t active = 0;
+	for (size_t i = 0; i < (size_t)film->width * film->height; ++i) {
+		if (film->converged[i]) continue;
+		film->converged[i] = pixel_error(film, i) < threshold;
+		if (!film->converged[i]) active++;
+	}
+	return active;
+}
+
+void film_publish(const struct film *film, struct texture *dst, int x, int y) {
+	for (unsigned fy = 0; fy < film->height; ++fy) {
+		for (unsigned fx = 0; fx < film->width; ++fx) {
+			const size_t idx = film_index(film, fx, fy);
+			if (!film->counts[idx]) continue;
+			const struct color average = colorCoef(1.0f / film->counts[idx], film->sums[idx]);
+			setPixel(dst, average, x + fx, y + fy);
+		}
+	}
+}
+
+void film_free(struct film *film) {
+	free(film->sums);
+	free(film->odd_sums);
+	free(film->counts);
+	free(film->converged);
+	*film = (struct film){ 0 };
+}
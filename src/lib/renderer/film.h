@@ -0,0 +1,79 @@
+//
+//  film.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../common/color.h"
+
+struct texture;
+
+// Samples taken for each pixel of a tile, summed up in a buffer owned by a single render thread.
+// Adding a sample is a plain add, and the shared result buffer is only written
+// when the averages get published, instead of being read and rewritten every sample.
+// Samples with an odd index are also summed up on their own, comparing the average
+// of those to the full average tells roughly how much noise is left in a pixel.
+struct film {
+	struct color *sums;
+	struct color *odd_sums;
+	uint32_t *counts;
+	bool *converged;
+	size_t capacity;
+	unsigned width;
+	unsigned height;
+};
+
+// Clears the film for a tile of the given size
+void film_reset(struct film *film, unsigned width, unsigned height);
+
+static inline size_t film_index(const struct film *film, unsigned x, unsigned y) {
+	return y * film->width + x;
+}
+
+// Samples taken so far for a pixel, this is also the index of the next one
+static inline uint32_t film_count(const struct film *film, unsigned x, unsigned y) {
+	return film->counts[film_index(film, x, y)];
+}
+
+static inline bool film_converged(const struct film *film, unsigned x, unsigned y) {
+	return film->converged[film_index(film, x, y)];
+}
+
+static inline void film_add(struct film *film, unsigned x, unsigned y, struct color sample) {
+	const size_t idx = film_index(film, x, y);
+	struct color *sum = &film->sums[idx];
+	const uint32_t taken = film->counts[idx];
+	// Drop NaN samples so they don't poison the pixel and its variance estimate.
+	// They count as the average so far instead, like nan_clamp() does.
+	if (sample.red != sample.red || sample.green != sample.green || sample.blue != sample.blue || sample.alpha != sample.alpha)
+		sample = taken ? colorCoef(1.0f / taken, *sum) : (struct color){ 0 };
+	*sum = colorAdd(*sum, sample);
+	if (taken & 1)
+		film->odd_sums[idx] = colorAdd(film->odd_sums[idx], sample);
+	film->counts[idx] = taken + 1;
+}
+
+// Samples each pixel still getting sampled takes in the next round, out of the budget a tile has left.
+// Samples that converged pixels don't take go to the rest, so those can end up with more than the
+// budget was made for per pixel. Returns 0 once the budget doesn't cover another sample for all of them.
+static inline size_t film_next_batch(size_t budget, size_t active, size_t max_batch) {
+	if (!active) return 0;
+	const size_t batch = budget / active;
+	return batch < max_batch ? batch : max_batch;
+}
+
+// Marks pixels whose estimated noise is below threshold as converged, those shouldn't get more samples.
+// Returns the amount of pixels still left to sample.
+size_t film_update_convergence(struct film *film, float threshold);
+
+// Writes the average of the samples in each pixel to dst, with the film placed at (x, y)
+void film_publish(const struct film *film, struct texture *dst, int x, int y);
+
+void film_free(struct film *film);
@@ -13,6 +13,7 @@
 #include "instance.h"
 #include "../datatypes/bbox.h"
 #include "../datatypes/mesh.h"
+#include "../datatypes/poly.h"
 #include "../datatypes/sphere.h"
 #include "../datatypes/scene.h"
 
@@ -38,21 +39,81 @@ static inline struct coord getTexMapSphere(const struct hitRecord *isect) {
 	return (struct coord){ u, v };
 }
 
+void instance_set_transform(struct instance *instance, struct transform composite) {
+	instance->composite = composite;
+	instance->tform_class = tform_classify(composite.A);
+}
+
+// Moves a ray to the local space of an instance, with only as much matrix math as its transform needs
+static inline struct lightRay instanceLocalRay(const struct instance *instance, float offset, const struct lightRay *ray) {
+	struct lightRay copy = *ray;
+	const struct matrix4x4 *inv = &instance->composite.Ainv;
+	const struct vector inv_translation = { inv->mtx[0][3], inv->mtx[1][3], inv->mtx[2][3] };
+	switch (instance->tform_class) {
+		case tform_class_identity:
+			break;
+		case tform_class_translate:
+			copy.start = vec_add(copy.start, inv_translation);
+			break;
+		case tform_class_translate_scale:
+			copy.start = vec_add(vec_scale(copy.start, inv->mtx[0][0]), inv_translation);
+			copy.direction = vec_scale(copy.direction, inv->mtx[0][0]);
+			break;
+		default:
+			tform_ray(&copy, *inv);
+			break;
+	}
+	copy.start = vec_add(copy.start, vec_scale(copy.direction, offset));
+	return copy;
+}
+
+// Moves the hit point and normal of a hit back to world space, see instanceLocalRay()
+static inline void instanceWorldHit(const struct instance *instance, struct hitRecord *isect) {
+	const struct matrix4x4 *mtx = &instance->composite.A;
+	const struct vector translation = { mtx->mtx[0][3], mtx->mtx[1][3], mtx->mtx[2][3] };
+	switch (instance->tform_class) {
+		case tform_class_identity:
+			break;
+		case tform_class_translate:
+			isect->hitPoint = vec_add(isect->hitPoint, translation);
+			break;
+		case tform_class_translate_scale:
+			isect->hitPoint = vec_add(vec_scale(isect->hitPoint, mtx->mtx[0][0]), translation);
+			// The transpose of the inverse is a uniform scale too
+			isect->surfaceNormal = vec_scale(isect->surfaceNormal, instance->composite.Ainv.mtx[0][0]);
+			break;
+		default:
+			tform_point(&isect->hitPoint, *mtx);
+			tform_vector_transpose(&isect->surfaceNormal, instance->composite.Ainv);
+			break;
+	}
+}
+
+static inline struct lightRay sphereLocalRay(const struct instance *instance, const struct sphere *sphere, const struct lightRay *ray) {
+	return instanceLocalRay(instance, sphere->rayOffset, ray);
+}
+
 static bool intersectSphere(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect, sampler *sampler) {
 	(void)sampler;
-	struct lightRay copy = *ray;
-	tform_ray(&copy, instance->composite.Ainv);
 	struct sphere *sphere = &((struct sphere_arr *)instance->object_arr)->items[instance->object_idx];
-	copy.start = vec_add(copy.start, vec_scale(copy.direction, sphere->rayOffset));
-	if (rayIntersectsWithSphere(&copy, sphere, isect)) {
-		isect->uv = getTexMapSphere(isect);
-		isect->polygon = NULL;
-		isect->bsdf = instance->bbuf->bsdfs.items[0];
-		tform_point(&isect->hitPoint, instance->composite.A);
-		tform_vector_transpose(&isect->surfaceNormal, instance->composite.Ainv);
-		return true;
-	}
-	return false;
+	const struct lightRay copy = sphereLocalRay(instance, sphere, ray);
+	return rayIntersectsWithSphere(&copy, sphere, isect);
+}
+
+static void getSphereSurface(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect) {
+	struct sphere *sphere = &((struct sphere_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = sphereLocalRay(instance, sphere, ray);
+	sphereHitAttributes(&copy, isect);
+	isect->uv = getTexMapSphere(isect);
+	isect->bsdf = instance->bbuf->bsdfs.items[0];
+	instanceWorldHit(instance, isect);
+}
+
+static bool occludedSphere(const struct instance *instance, const struct lightRay *ray, float max_dist, sampler *sampler) {
+	(void)sampler;
+	struct sphere *sphere = &((struct sphere_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = sphereLocalRay(instance, sphere, ray);
+	return rayOccludedBySphere(&copy, sphere, max_dist);
 }
 
 static bool intersectSphereVolume(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect, sampler *sampler) {
@@ -128,11 +189,66 @@ struct instance new_sphere_instance(struct sphere_arr *spheres, size_t idx, floa
 			.object_idx = idx,
 			.composite = tform_new(),
 			.intersectFn = intersectSphere,
+			.occludedFn = occludedSphere,
+			.getSurfaceFn = getSphereSurface,
 			.getBBoxAndCenterFn = getSphereBBoxAndCenter
 		};
 	}
 }
 
+static inline struct lightRay sphereSetLocalRay(const struct instance *instance, const struct sphere_set *set, const struct lightRay *ray) {
+	return instanceLocalRay(instance, set->rayOffset, ray);
+}
+
+static bool intersectSphereSet(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect, sampler *sampler) {
+	(void)sampler;
+	struct sphere_set *set = &((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = sphereSetLocalRay(instance, set, ray);
+	return traverse_sphere_set_bvh(set, &copy, isect);
+}
+
+static void getSphereSetSurface(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect) {
+	struct sphere_set *set = &((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = sphereSetLocalRay(instance, set, ray);
+	isect->hitPoint = alongRay(&copy, isect->distance);
+	isect->surfaceNormal = vec_normalize(vec_sub(isect->hitPoint, set->centers.items[isect->primIndex]));
+	isect->uv = getTexMapSphere(isect);
+	isect->bsdf = instance->bbuf->bsdfs.items[0];
+	instanceWorldHit(instance, isect);
+	isect->surfaceNormal = vec_normalize(isect->surfaceNormal);
+}
+
+static bool occludedSphereSet(const struct instance *instance, const struct lightRay *ray, float max_dist, sampler *sampler) {
+	(void)sampler;
+	struct sphere_set *set = &((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = sphereSetLocalRay(instance, set, ray);
+	return traverse_sphere_set_bvh_occluded(set, &copy, max_dist);
+}
+
+static void getSphereSetBBoxAndCenter(const struct instance *instance, struct boundingBox *bbox, struct vector *center) {
+	struct sphere_set *set = &((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx];
+	*bbox = get_root_bbox(set->bvh);
+	tform_bbox(bbox, instance->composite.A);
+	*center = bboxCenter(bbox);
+	set->rayOffset = rayOffset(*bbox);
+}
+
+struct instance new_sphere_set_instance(struct sphere_set_arr *sets, size_t idx) {
+	return (struct instance) {
+		.object_arr = sets,
+		.object_idx = idx,
+		.composite = tform_new(),
+		.intersectFn = intersectSphereSet,
+		.occludedFn = occludedSphereSet,
+		.getSurfaceFn = getSphereSetSurface,
+		.getBBoxAndCenterFn = getSphereSetBBoxAndCenter
+	};
+}
+
+bool isSphereSet(const struct instance *instance) {
+	return instance->intersectFn == intersectSphereSet;
+}
+
 static struct coord getTexMapMesh(const struct mesh *mesh, const struct hitRecord *isect) {
 	if (mesh->vbuf->texture_coords.count == 0) return (struct coord){-1.0f, -1.0f};
 	struct poly *p = isect->polygon;
@@ -152,21 +268,43 @@ static struct coord getTexMapMesh(const struct mesh *mesh, const struct hitRecor
 	return coord_add(coord_add(ucomponent, vcomponent), wcomponent);
 }
 
+static inline struct lightRay meshLocalRay(const struct instance *instance, const struct mesh *mesh, const struct lightRay *ray) {
+	return instanceLocalRay(instance, mesh->rayOffset, ray);
+}
+
 static bool intersectMesh(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect, sampler *sampler) {
-	struct lightRay copy = *ray;
-	tform_ray(&copy, instance->composite.Ainv);
 	struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
-	copy.start = vec_add(copy.start, vec_scale(copy.direction, mesh->rayOffset));
-	if (traverse_bottom_level_bvh(mesh, &copy, isect, sampler)) {
-		// Repopulate uv with actual texture mapping
-		isect->uv = getTexMapMesh(mesh, isect);
-		isect->bsdf = instance->bbuf->bsdfs.items[isect->polygon->materialIndex];
-		tform_point(&isect->hitPoint, instance->composite.A);
-		tform_vector_transpose(&isect->surfaceNormal, instance->composite.Ainv);
-		isect->surfaceNormal = vec_normalize(isect->surfaceNormal);
-		return true;
+	const struct lightRay copy = meshLocalRay(instance, mesh, ray);
+	return traverse_bottom_level_bvh(mesh, &copy, isect, sampler);
+}
+
+static unsigned intersectMeshPacket(const struct instance *instance, const struct lightRay *rays, struct hitRecord *isects, unsigned active, sampler **samplers) {
+	struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+	struct lightRay copies[RAY_PACKET_SIZE];
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+		if (active & (1u << r))
+			copies[r] = meshLocalRay(instance, mesh, &rays[r]);
 	}
-	return false;
+	return traverse_bottom_level_bvh_packet(mesh, copies, isects, active, samplers);
+}
+
+static void getMeshSurface(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect) {
+	struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = meshLocalRay(instance, mesh, ray);
+	const struct triangle tri = make_triangle(mesh, isect->polygon);
+	polygonHitAttributes(mesh, isect->polygon, &tri, &copy, isect);
+	// Repopulate uv with actual texture mapping
+	isect->uv = getTexMapMesh(mesh, isect);
+	isect->bsdf = instance->bbuf->bsdfs.items[isect->polygon->materialIndex];
+	instanceWorldHit(instance, isect);
+	isect->surfaceNormal = vec_normalize(isect->surfaceNormal);
+}
+
+static bool occludedMesh(const struct instance *instance, const struct lightRay *ray, float max_dist, sampler *sampler) {
+	(void)sampler;
+	struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+	const struct lightRay copy = meshLocalRay(instance, mesh, ray);
+	return traverse_bottom_level_bvh_occluded(mesh, &copy, max_dist);
 }
 
 static bool intersectMeshVolume(const struct instance *instance, const struct lightRay *ray, struct hitRecord *isect, sampler *sampler) {
@@ -242,7 +380,125 @@ struct instance new_mesh_instance(struct mesh_arr *meshes, size_t idx, float *de
 			.object_idx = idx,
 			.composite = tform_new(),
 			.intersectFn = intersectMesh,
+			.intersectPacketFn = intersectMeshPacket,
+			.occludedFn = occludedMesh,
+			.getSurfaceFn = getMeshSurface,
 			.getBBoxAndCenterFn = getMeshBBoxAndCenter
 		};
 	}
 }
+
+bool isSphere(const struct instance *instance) {
+	return instance->intersectFn == intersectSphere;
+}
+
+// Spheres can only be sampled evenly if their instance doesn't squash them. Rotations keep them round,
+// so then the scale is the length of any transformed axis, as long as the axes stay equal and square.
+static inline float sphereScale(const struct instance *instance) {
+	const struct matrix4x4 *A = &instance->composite.A;
+	switch (instance->tform_class) {
+		case tform_class_identity:
+		case tform_class_translate:
+			return 1.0f;
+		case tform_class_translate_scale:
+			return A->mtx[0][0];
+		default:
+			break;
+	}
+	if (A->mtx[3][0] != 0.0f || A->mtx[3][1] != 0.0f || A->mtx[3][2] != 0.0f || A->mtx[3][3] != 1.0f) return 0.0f;
+	struct vector axes[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+	for (int i = 0; i < 3; ++i)
+		tform_vector(&axes[i], *A);
+	const float scale = vec_length(axes[0]);
+	const float tolerance = 1e-4f * scale;
+	for (int i = 0; i < 3; ++i) {
+		if (fabsf(vec_length(axes[i]) - scale) > tolerance) return 0.0f;
+		if (fabsf(vec_dot(axes[i], axes[(i + 1) % 3])) > tolerance * scale) return 0.0f;
+	}
+	return scale;
+}
+
+size_t instance_primitive_count(const struct instance *instance) {
+	if (isMesh(instance)) return ((struct mesh_arr *)instance->object_arr)->items[instance->object_idx].polygons.count;
+	if (!(sphereScale(instance) > 0.0f)) return 0;
+	if (isSphere(instance)) return 1;
+	if (isSphereSet(instance)) return ((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx].centers.count;
+	return 0;
+}
+
+const struct bsdfNode *instance_primitive_bsdf(const struct instance *instance, size_t prim) {
+	if (isMesh(instance)) {
+		const struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+		return instance->bbuf->bsdfs.items[mesh->polygons.items[prim].materialIndex];
+	}
+	return instance->bbuf->bsdfs.items[0];
+}
+
+float instance_primitive_area(const struct instance *instance, size_t prim) {
+	if (isMesh(instance)) {
+		const struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+		const struct triangle tri = make_triangle(mesh, &mesh->polygons.items[prim]);
+		struct vector v0 = tri.v0;
+		struct vector v1 = vec_sub(tri.v0, tri.e1);
+		struct vector v2 = vec_add(tri.v0, tri.e2);
+		tform_point(&v0, instance->composite.A);
+		tform_point(&v1, instance->composite.A);
+		tform_point(&v2, instance->composite.A);
+		return 0.5f * vec_length(vec_cross(vec_sub(v1, v0), vec_sub(v2, v0)));
+	}
+	const float radius = isSphereSet(instance)
+		? ((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx].radii.items[prim] * sphereScale(instance)
+		: ((struct sphere_arr *)instance->object_arr)->items[instance->object_idx].radius * sphereScale(instance);
+	return 4.0f * PI * radius * radius;
+}
+
+void instance_sample_surface(const struct instance *instance, size_t prim, struct coord u, struct hitRecord *isect) {
+	if (isMesh(instance)) {
+		struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+		struct poly *poly = &mesh->polygons.items[prim];
+		const struct triangle tri = make_triangle(mesh, poly);
+		// Barycentrics spread evenly over the triangle, same convention as rayIntersectsWithTriangle()
+		const float su = sqrtf(u.x);
+		isect->uv = (struct coord){ 1.0f - su, u.y * su };
+		isect->hitPoint = vec_add(vec_sub(tri.v0, vec_scale(tri.e1, isect->uv.x)), vec_scale(tri.e2, isect->uv.y));
+		if (poly->hasNormals) {
+			const float w = 1.0f - isect->uv.x - isect->uv.y;
+			const struct vector *normals = mesh->vbuf->normals.items;
+			isect->surfaceNormal = vec_add(vec_add(vec_scale(normals[poly->normalIndex[1]], isect->uv.x),
+				vec_scale(normals[poly->normalIndex[2]], isect->uv.y)), vec_scale(normals[poly->normalIndex[0]], w));
+		} else {
+			isect->surfaceNormal = tri.n;
+		}
+		isect->polygon = poly;
+		isect->uv = getTexMapMesh(mesh, isect);
+		isect->bsdf = instance->bbuf->bsdfs.items[poly->materialIndex];
+	} else {
+		const float z = 1.0f - 2.0f * u.x;
+		const float r = sqrtf(max(0.0f, 1.0f - z * z));
+		const float phi = 2.0f * PI * u.y;
+		isect->surfaceNormal = (struct vector){ r * cosf(phi), r * sinf(phi), z };
+		if (isSphereSet(instance)) {
+			const struct sphere_set *set = &((struct sphere_set_arr *)instance->object_arr)->items[instance->object_idx];
+			isect->hitPoint = vec_add(set->centers.items[prim], vec_scale(isect->surfaceNormal, set->radii.items[prim]));
+			isect->primIndex = prim;
+		} else {
+			const struct sphere *sphere = &((struct sphere_arr *)instance->object_arr)->items[instance->object_idx];
+			isect->hitPoint = vec_scale(isect->surfaceNormal, sphere->radius);
+		}
+		isect->polygon = NULL;
+		isect->uv = getTexMapSphere(isect);
+		isect->bsdf = instance->bbuf->bsdfs.items[0];
+	}
+	instanceWorldHit(instance, isect);
+	isect->surfaceNormal = vec_normalize(isect->surfaceNormal);
+}
+
+struct vector instance_geometric_normal(const struct instance *instance, const struct hitRecord *isect) {
+	if (!isMesh(instance)) return vec_normalize(isect->surfaceNormal);
+	const struct mesh *mesh = &((struct mesh_arr *)instance->object_arr)->items[instance->object_idx];
+	struct vector normal = make_triangle(mesh, isect->polygon).n;
+	// Uniform scales and translations don't turn it
+	if (instance->tform_class == tform_class_generic)
+		tform_vector_transpose(&normal, instance->composite.Ainv);
+	return vec_normalize(normal);
+}
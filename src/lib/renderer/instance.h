@@ -23,10 +23,18 @@ struct hitRecord;
 
 struct instance {
 	struct transform composite;
+	enum tform_class tform_class; // Set by instance_set_transform(), to skip the matrix math it doesn't need
 	struct bsdf_buffer *bbuf;
 	size_t bbuf_idx;
 	bool emits_light;
+	// Only records the distance, primitive and barycentrics of a hit, see getSurfaceFn
 	bool (*intersectFn)(const struct instance *, const struct lightRay *, struct hitRecord *, sampler *);
+	// Optional, intersects the rays of a packet selected by a bit mask, returns the mask of rays that hit
+	unsigned (*intersectPacketFn)(const struct instance *, const struct lightRay *, struct hitRecord *, unsigned, sampler **);
+	// Optional, returns true if the ray hits the instance closer than the given distance
+	bool (*occludedFn)(const struct instance *, const struct lightRay *, float, sampler *);
+	// Optional, fills in the rest of the hit record once the closest hit is known
+	void (*getSurfaceFn)(const struct instance *, const struct lightRay *, struct hitRecord *);
 	void (*getBBoxAndCenterFn)(const struct instance *, struct boundingBox *, struct vector *);
 	void *object_arr;
 	size_t object_idx;
@@ -37,5 +45,23 @@ dyn_array_def(instance)
 
 struct instance new_sphere_instance(struct sphere_arr *spheres, size_t idx, float *density, struct block **pool);
 struct instance new_mesh_instance(struct mesh_arr *meshes, size_t idx, float *density, struct block **pool);
+struct instance new_sphere_set_instance(struct sphere_set_arr *sets, size_t idx);
+
+// Sets the transform of an instance, and picks the cheapest way to apply it to rays and hits
+void instance_set_transform(struct instance *instance, struct transform composite);
 
 bool isMesh(const struct instance *instance);
+bool isSphere(const struct instance *instance);
+bool isSphereSet(const struct instance *instance);
+
+// Primitives of an instance the light list can sample points on: the polygons of a mesh, its one sphere
+// or the spheres of a set. Volumes and spheres squashed by a non-uniform scale or shear have none.
+size_t instance_primitive_count(const struct instance *instance);
+const struct bsdfNode *instance_primitive_bsdf(const struct instance *instance, size_t prim);
+// World space area of a primitive
+float instance_primitive_area(const struct instance *instance, size_t prim);
+// Fills in a hit record for the point `u` maps to on a primitive, as if a ray had hit it there.
+// Points are spread evenly over the area of the primitive for u in [0,1)^2.
+void instance_sample_surface(const struct instance *instance, size_t prim, struct coord u, struct hitRecord *isect);
+// World space geometric normal at a hit, normalized. Unlike the shading normal, this isn't flipped towards the ray
+struct vector instance_geometric_normal(const struct instance *instance, const struct hitRecord *isect);
@@ -0,0 +1,134 @@
+//
+//  lights.c
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../includes.h"
+#include "lights.h"
+
+#include <float.h>
+#include "../datatypes/scene.h"
+#include "../datatypes/bbox.h"
+#include "../accelerators/bvh.h"
+#include "../../common/logging.h"
+#include "instance.h"
+
+bool light_list_build(struct light_list *list, struct world *scene) {
+	list->lights.count = 0;
+	list->cdf.count = 0;
+	list->total_area = 0.0f;
+	struct boundingBox bounds = emptyBBox;
+	bool changed = false;
+	for (size_t i = 0; i < scene->instances.count; ++i) {
+		struct instance *instance = &scene->instances.items[i];
+		const size_t prims = instance_primitive_count(instance);
+		if (!prims && (isSphere(instance) || isSphereSet(instance)) && instance->bbuf->bsdfs.items[0]->emitted)
+			logr(warning, "Emissive sphere instance %zu is squashed by its transform, so it's only found by rays that hit it\n", i);
+		bool emits_light = false;
+		for (size_t p = 0; p < prims; ++p) {
+			if (!instance_primitive_bsdf(instance, p)->emitted) continue;
+			const float area = instance_primitive_area(instance, p);
+			if (!(area > 0.0f)) continue;
+			list->total_area += area;
+			light_arr_add(&list->lights, (struct light){ .instance = i, .prim = p });
+			float_arr_add(&list->cdf, list->total_area);
+			emits_light = true;
+		}
+		changed |= emits_light != instance->emits_light;
+		instance->emits_light = emits_light;
+
+		// Volumes don't report a bounding box
+		struct boundingBox bbox = emptyBBox;
+		struct vector center;
+		instance->getBBoxAndCenterFn(instance, &bbox, &center);
+		extendBBox(&bounds, &bbox);
+	}
+	// No instance offsets its rays further than the scene bounds would
+	list->shadow_epsilon = list->lights.count ? 2.0f * rayOffset(bounds) : 0.0f;
+	if (list->lights.count)
+		logr(debug, "Light list has %zu emissive primitives\n", list->lights.count);
+	return changed;
+}
+
+void light_list_free(struct light_list *list) {
+	light_arr_free(&list->lights);
+	float_arr_free(&list->cdf);
+	list->total_area = 0.0f;
+}
+
+static inline float power_heuristic(float pdf, float other) {
+	const float a = pdf * pdf;
+	return a / (a + other * other);
+}
+
+// Cosine at the light between its surface and a direction pointing away from the viewer.
+// Polygons emit from both sides, like they get shaded on both, spheres only outwards.
+static inline float light_cosine(const struct instance *instance, const struct hitRecord *point, struct vector dir) {
+	const float cosine = -vec_dot(instance_geometric_normal(instance, point), dir);
+	return isMesh(instance) ? fabsf(cosine) : cosine;
+}
+
+static size_t pick_light(const struct light_list *list, float u) {
+	const float target = u * list->total_area;
+	size_t lo = 0;
+	size_t hi = list->cdf.count - 1;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (list->cdf.items[mid] > target)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+struct color light_sample_direct(const struct world *scene, const struct hitRecord *isect, sampler *sampler) {
+	const struct light_list *list = &scene->lights;
+	if (!list->lights.count) return g_black_color;
+	float u[3];
+	getDimensions(sampler, u, 3);
+	const struct light *light = &list->lights.items[pick_light(list, u[0])];
+	const struct instance *instance = &scene->instances.items[light->instance];
+
+	struct lightRay shadow = { .start = isect->hitPoint, .type = rt_shadow };
+	struct hitRecord point = { .incident = &shadow, .instIndex = (int)light->instance };
+	instance_sample_surface(instance, light->prim, (struct coord){ u[1], u[2] }, &point);
+	const struct vector to_light = vec_sub(point.hitPoint, isect->hitPoint);
+	const float dist_sq = vec_dot(to_light, to_light);
+	const float dist = sqrtf(dist_sq);
+	if (dist <= list->shadow_epsilon) return g_black_color;
+	shadow.direction = vec_scale(to_light, 1.0f / dist);
+	point.distance = dist;
+
+	const float cos_light = light_cosine(instance, &point, shadow.direction);
+	if (cos_light <= 0.0f) return g_black_color;
+	const struct color f = isect->bsdf->eval(isect->bsdf, sampler, isect, shadow.direction);
+	if (f.red == 0.0f && f.green == 0.0f && f.blue == 0.0f) return g_black_color;
+	// Hit distances get less precise further away, curved surfaces especially, so stop a bit shorter there
+	const float max_dist = dist * 0.999f - list->shadow_epsilon;
+	if (traverse_top_level_bvh_occluded(scene_traced_instances(scene).items, scene->topLevel, &shadow, max_dist, sampler))
+		return g_black_color;
+
+	const struct color emitted = point.bsdf->emitted(point.bsdf, sampler, &point);
+	const float light_pdf = dist_sq / (cos_light * list->total_area);
+	const float bsdf_pdf = isect->bsdf->pdf(isect->bsdf, sampler, isect, shadow.direction);
+	return colorCoef(power_heuristic(light_pdf, bsdf_pdf) / light_pdf, colorMul(f, emitted));
+}
+
+float light_mis_weight(const struct world *scene, const struct hitRecord *isect, float bsdf_pdf) {
+	if (bsdf_pdf <= 0.0f || !isect->bsdf->emitted) return 1.0f;
+	const struct instance *instance = &scene_traced_instances(scene).items[isect->instIndex];
+	if (!instance->emits_light) return 1.0f;
+	const struct vector to_hit = vec_sub(isect->hitPoint, isect->incident->start);
+	const float dist_sq = vec_dot(to_hit, to_hit);
+	const float dist = sqrtf(dist_sq);
+	// Light sampling skips these, so this is the only way to find them
+	if (dist <= scene->lights.shadow_epsilon) return 1.0f;
+	const float cos_light = light_cosine(instance, isect, vec_scale(to_hit, 1.0f / dist));
+	if (cos_light <= 0.0f) return 1.0f;
+	const float light_pdf = dist_sq / (cos_light * scene->lights.total_area);
+	return power_heuristic(bsdf_pdf, light_pdf);
+}
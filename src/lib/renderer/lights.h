@@ -0,0 +1,53 @@
+//
+//  lights.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "../../common/color.h"
+#include "../../common/dyn_array.h"
+#include "samplers/sampler.h"
+
+struct world;
+struct hitRecord;
+
+struct light {
+	size_t instance; // Index in scene->instances
+	size_t prim;
+};
+
+typedef struct light light;
+dyn_array_def(light)
+
+// Every primitive in the scene with an emissive shader, rebuilt at the start of each render.
+// Lights get picked in proportion to their area, so every point on them is equally likely.
+struct light_list {
+	struct light_arr lights;
+	struct float_arr cdf; // Running total of the light areas
+	float total_area;
+	// Shadow rays stop this far short of the light, so that they don't hit the light itself
+	float shadow_epsilon;
+};
+
+/// Gathers the emissive primitives of the scene, and flags the instances they belong to with emits_light.
+/// Needs the mesh BVHs for the scene bounds, so run it after those have been built.
+/// @return true if the set of emissive instances changed
+bool light_list_build(struct light_list *list, struct world *scene);
+void light_list_free(struct light_list *list);
+
+/// Next event estimation: picks a point on a light, and returns the light it reflects off of
+/// the hit towards the viewer, if nothing is in the way. Weighted against the hit's BSDF picking
+/// the same direction with multiple importance sampling, see light_mis_weight()
+/// @remark The hit shader must have eval and pdf
+struct color light_sample_direct(const struct world *scene, const struct hitRecord *isect, sampler *sampler);
+
+/// The weight for emission picked up by a ray sampled from a BSDF, against light_sample_direct()
+/// having found the same point.
+/// @param bsdf_pdf Density of the previous bounce picking the ray, 0 if that bounce didn't sample lights
+float light_mis_weight(const struct world *scene, const struct hitRecord *isect, float bsdf_pdf);
@@ -21,35 +21,46 @@
 #include "samplers/sampler.h"
 #include "sky.h"
 #include "../renderer/instance.h"
+#include "lights.h"
 #include "../nodes/shaders/background.h"
 
 static inline struct hitRecord getClosestIsect(struct lightRay *incidentRay, const struct world *scene, sampler *sampler) {
 	//TODO: Consider passing in last instance idx + polygon to detect self-intersections?
 	struct hitRecord isect = { .incident = incidentRay, .instIndex = -1, .distance = FLT_MAX, .polygon = NULL };
-	traverse_top_level_bvh(scene->instances.items, scene->topLevel, incidentRay, &isect, sampler);
+	traverse_top_level_bvh(scene_traced_instances(scene).items, scene->topLevel, incidentRay, &isect, sampler);
 	return isect;
 }
 
-struct color path_trace(struct lightRay incident, const struct world *scene, int max_bounces, sampler *sampler) {
+// first_hit is optional, and is used instead of tracing the incident ray if given
+static struct color trace_path(struct lightRay incident, const struct hitRecord *first_hit, const struct world *scene, int max_bounces, sampler *sampler) {
 	struct color path_weight = g_white_color;
 	struct color path_radiance = g_black_color; // Final path contribution "color"
 	struct lightRay currentRay = incident;
+	float bsdf_pdf = 0.0f; // Of the ray the last bounce sampled, if that bounce sampled lights too
 
 	for (int bounce = 0; bounce <= max_bounces; ++bounce) {
-		const struct hitRecord isect = getClosestIsect(&currentRay, scene, sampler);
+		// The first hit was traced with its packet, which already did this
+		if (bounce > 0 || !first_hit) samplerSetBounce(sampler, bounce);
+		const struct hitRecord isect = bounce == 0 && first_hit ? *first_hit : getClosestIsect(&currentRay, scene, sampler);
 		if (isect.instIndex < 0) {
 			path_radiance = colorAdd(path_radiance, colorMul(path_weight, scene->background->sample(scene->background, sampler, &isect).weight));
 			break;
 		}
 		
 		const struct bsdfSample sample = isect.bsdf->sample(isect.bsdf, sampler, &isect);
-		//TODO: emission contribution needs to be adjusted down by probability of randomly hitting it
-		//FIXME: emits_light only gets set if the root node of a shader graph is emissive, so maybe fix that
-		// if (true || scene->instances[isect.instIndex].emits_light) {
-			path_radiance = colorAdd(path_radiance, colorMul(path_weight, sample.emitted));
-		// }
+		const float emission_weight = light_mis_weight(scene, &isect, bsdf_pdf);
+		path_radiance = colorAdd(path_radiance, colorMul(path_weight, colorCoef(emission_weight, sample.emitted)));
 		if (bounce == max_bounces) break;
 
+		// Next event estimation, which finds small lights far more often than the sampled ray would
+		bsdf_pdf = 0.0f;
+		if (scene->lights.lights.count && isect.bsdf->eval) {
+			path_radiance = colorAdd(path_radiance, colorMul(path_weight, light_sample_direct(scene, &isect, sampler)));
+			// Light sampling can't find sharp reflections, so those keep all of the light they hit
+			if (!(sample.out.type & rt_singular))
+				bsdf_pdf = isect.bsdf->pdf(isect.bsdf, sampler, &isect, vec_normalize(sample.out.direction));
+		}
+
 		currentRay = sample.out;
 		const struct color attenuation = sample.weight;
 		
@@ -65,3 +76,23 @@ struct color path_trace(struct lightRay incident, const struct world *scene, int
 	}
 	return path_radiance;
 }
+
+struct color path_trace(struct lightRay incident, const struct world *scene, int max_bounces, sampler *sampler) {
+	return trace_path(incident, NULL, scene, max_bounces, sampler);
+}
+
+void path_trace_packet(const struct lightRay *incident, size_t count, const struct world *scene, int max_bounces, sampler **samplers, struct color *out) {
+	// Only the first `count` rays are traced, the rest are zeroed to keep the compiler happy
+	struct lightRay rays[RAY_PACKET_SIZE] = { 0 };
+	struct hitRecord isects[RAY_PACKET_SIZE];
+	for (size_t i = 0; i < count; ++i) {
+		rays[i] = incident[i];
+		samplerSetBounce(samplers[i], 0);
+		isects[i] = (struct hitRecord){ .incident = &rays[i], .instIndex = -1, .distance = FLT_MAX, .polygon = NULL };
+	}
+	const unsigned active = (1u << count) - 1;
+	traverse_top_level_bvh_packet(scene_traced_instances(scene).items, scene->topLevel, rays, isects, active, samplers);
+	// Secondary rays are incoherent, so paths carry on one by one from here
+	for (size_t i = 0; i < count; ++i)
+		out[i] = trace_path(rays[i], &isects[i], scene, max_bounces, samplers[i]);
+}
@@ -14,3 +14,7 @@
 struct world;
 
 struct color path_trace(struct lightRay incident, const struct world *scene, int max_bounces, sampler *sampler);
+
+/// Traces a batch of up to RAY_PACKET_SIZE paths, whose coherent first bounce is traced as a packet.
+/// Gives the same results as calling path_trace() for each incident ray, with its own sampler.
+void path_trace_packet(const struct lightRay *incident, size_t count, const struct world *scene, int max_bounces, sampler **samplers, struct color *out);
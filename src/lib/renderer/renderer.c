@@ -11,12 +11,16 @@
 
 #include "renderer.h"
 #include "pathtrace.h"
+#include "wavefront.h"
+#include "film.h"
 #include "../../common/logging.h"
 #include "../../common/timer.h"
 #include "../../common/texture.h"
 #include "../../common/platform/thread.h"
+#include "../../common/platform/thread_pool.h"
 #include "../../common/platform/mutex.h"
 #include "../../common/platform/capabilities.h"
+#include "../../common/platform/atomic.h"
 #include "../../common/platform/signal.h"
 #include "../../common/string.h"
 #include "../datatypes/mesh.h"
@@ -27,11 +31,20 @@
 #include "../protocol/server.h"
 #include "../accelerators/bvh.h"
 #include "samplers/sampler.h"
+#include <math.h>
 
 //Main thread loop speeds
 #define paused_msec 100
 #define active_msec  16
 
+// Samples taken per pixel before a tile is published to the result buffer
+#define FILM_PUBLISH_SAMPLES 4
+
+// Below this many samples, the noise estimates themselves are too noisy to stop sampling a pixel.
+static size_t adaptive_min_samples(float noise_threshold) {
+	return (size_t)ceilf(4.0f / sqrtf(noise_threshold));
+}
+
 static bool g_aborted = false;
 
 void sigHandler(int sig) {
@@ -46,7 +59,12 @@ static void print_stats(const struct world *scene) {
 	uint64_t polys = 0;
 	uint64_t vertices = 0;
 	uint64_t normals = 0;
+	uint64_t spheres = scene->spheres.count;
+	for (size_t i = 0; i < scene->sphere_sets.count; ++i)
+		spheres += scene->sphere_sets.items[i].centers.count;
+	size_t tform_classes[tform_class_generic + 1] = { 0 };
 	for (size_t i = 0; i < scene->instances.count; ++i) {
+		tform_classes[scene->instances.items[i].tform_class]++;
 		if (isMesh(&scene->instances.items[i])) {
 			const struct mesh *mesh = &scene->meshes.items[scene->instances.items[i].object_idx];
 			polys += mesh->polygons.count;
@@ -54,13 +72,36 @@ static void print_stats(const struct world *scene) {
 			normals += mesh->vbuf->normals.count;
 		}
 	}
-	logr(info, "Totals: %liV, %liN, %zuI, %liP, %zuS, %zuM\n",
+	logr(info, "Totals: %liV, %liN, %zuI, %liP, %liS, %zuM\n",
 		   vertices,
 		   normals,
 		   scene->instances.count,
 		   polys,
-		   scene->spheres.count,
+		   spheres,
 		   scene->meshes.count);
+	logr(info, "Instance transforms: %zu identity, %zu translated, %zu scaled, %zu generic\n",
+		   tform_classes[tform_class_identity],
+		   tform_classes[tform_class_translate],
+		   tform_classes[tform_class_translate_scale],
+		   tform_classes[tform_class_generic]);
+}
+
+// Merges the static meshes of the scene again if what gets merged changed, or drops the merged
+// copy if flattening was turned off. Instances that were only moved are copied over as they are.
+// Returns true if the traced instances changed.
+static bool update_flat_scene(struct world *scene, const struct prefs prefs) {
+	bool changed = false;
+	if (scene->flat && (!prefs.flatten_scene || scene->flat_dirty || !flat_scene_refresh(scene->flat, scene))) {
+		destroy_flat_scene(scene->flat);
+		scene->flat = NULL;
+		changed = true;
+	}
+	if (prefs.flatten_scene && !scene->flat) {
+		scene->flat = flatten_scene(scene);
+		changed |= scene->flat != NULL;
+	}
+	scene->flat_dirty = false;
+	return changed;
 }
 
 void *render_thread(void *arg);
@@ -88,11 +129,14 @@ void update_cb_info(struct renderer *r, struct tile_set *set, struct cr_renderer
 		avg_tile_pass_us /= ctr++;
 	}
 	double avg_per_ray_us = (double)avg_tile_pass_us / (double)(r->prefs.tileHeight * r->prefs.tileWidth);
-	uint64_t completed_samples = 0;
-	for (size_t t = 0; t < r->state.workers.count; ++t) {
-		completed_samples += r->state.workers.items[t].totalSamples;
+	// Tiles that converged early with adaptive sampling don't need the rest of their samples
+	uint64_t remainingTileSamples = 0;
+	for (size_t t = 0; t < set->tiles.count; ++t) {
+		struct render_tile *tile = &set->tiles.items[t];
+		if (tile->state == finished) continue;
+		const size_t total = cr_atomic_load(&tile->total_samples);
+		remainingTileSamples += total - min(total, cr_atomic_load(&tile->completed_samples));
 	}
-	uint64_t remainingTileSamples = (set->tiles.count * r->prefs.sampleCount) - completed_samples;
 	uint64_t eta_ms_till_done = (avg_tile_pass_us * remainingTileSamples) / 1000;
 	eta_ms_till_done /= (r->prefs.threads + remote_threads);
 	uint64_t sps = (1000000 / avg_per_ray_us) * (r->prefs.threads + remote_threads);
@@ -103,8 +147,17 @@ void update_cb_info(struct renderer *r, struct tile_set *set, struct cr_renderer
 	i->eta_ms = eta_ms_till_done;
 	i->completion = r->prefs.iterative ?
 		((double)r->state.finishedPasses / (double)r->prefs.sampleCount) :
-		((double)set->finished / (double)set->tiles.count);
+		((double)tile_set_started(set) / (double)set->tiles.count);
+
+}
 
+static void worker_task(void *arg) {
+	struct worker *worker = arg;
+	// Pool threads outlive the render, so let them float freely again afterwards
+	const struct sys_topology *topology = &worker->renderer->state.topology;
+	const bool pinned = worker->cpu >= 0 && sys_set_thread_affinity(&worker->cpu, 1);
+	worker->thread_fn(worker);
+	if (pinned) sys_set_thread_affinity(topology->cpus, topology->cpu_count);
 }
 
 static void *thread_stub(void *arg) {
@@ -143,11 +196,19 @@ void renderer_render(struct renderer *r) {
 		r->prefs.threads = 1;
 	}
 
+	// Image textures may still be decoding in the background. Ones added during the render
+	// are decoded right away instead, since render threads could already be reading them.
+	thread_pool_wait_group(r->state.pool, &r->scene->texture_loads);
+	r->scene->pool = NULL;
+
 	if (!r->scene->background) {
 		r->scene->background = newBackground(&r->scene->storage, NULL, NULL, NULL, r->scene->use_blender_coordinates);
 	}
 	
-	struct tile_set set = tile_quantize(camera->width, camera->height, r->prefs.tileWidth, r->prefs.tileHeight, r->prefs.tileOrder);
+	size_t total_threads = r->prefs.threads;
+	for (size_t i = 0; i < r->state.clients.count; ++i)
+		total_threads += r->state.clients.items[i].available_threads;
+	struct tile_set set = tile_quantize(camera->width, camera->height, r->prefs.tileWidth, r->prefs.tileHeight, r->prefs.tileOrder, total_threads);
 	r->state.current_set = &set;
 
 	for (size_t i = 0; i < r->scene->shader_buffers.count; ++i) {
@@ -161,6 +222,13 @@ void renderer_render(struct renderer *r) {
 		struct instance *inst = &r->scene->instances.items[i];
 		inst->bbuf = &r->scene->shader_buffers.items[inst->bbuf_idx];
 	}
+	if (r->scene->flat) {
+		// The last one is the merged mesh, which has a buffer of its own
+		for (size_t i = 0; i + 1 < r->scene->flat->instances.count; ++i) {
+			struct instance *inst = &r->scene->flat->instances.items[i];
+			inst->bbuf = &r->scene->shader_buffers.items[inst->bbuf_idx];
+		}
+	}
 	
 	for (size_t i = 0; i < r->scene->meshes.count; ++i) {
 		struct mesh *m = &r->scene->meshes.items[i];
@@ -169,20 +237,57 @@ void renderer_render(struct renderer *r) {
 
 	// Do some pre-render preparations
 	// Compute BVH acceleration structures for all meshes in the scene
-	compute_accels(r->scene->meshes);
+	// Instance bounds depend on the mesh BVHs
+	if (compute_accels(r->state.pool, r->scene->meshes, r->prefs.bvh_params))
+		r->scene->instances_dirty = true;
+	if (compute_sphere_set_accels(r->state.pool, r->scene->sphere_sets, r->prefs.bvh_params))
+		r->scene->instances_dirty = true;
+
+	// Emissive instances get flagged here, which the merged instance has to pick up
+	if (light_list_build(&r->scene->lights, r->scene))
+		r->scene->instances_dirty = true;
+
+	// Merging static meshes needs their BVHs too, to compare the traversal cost
+	const bool flattened = update_flat_scene(r->scene, r->prefs);
+	if (flattened) {
+		if (r->scene->flat)
+			compute_accels(r->state.pool, r->scene->flat->meshes, r->prefs.bvh_params);
+		// The instance list changed, refitting won't do
+		destroy_bvh(r->scene->topLevel);
+		r->scene->topLevel = NULL;
+		r->scene->instances_dirty = true;
+	}
 
 	// And then compute a single top-level BVH that contains all the objects
+	// If only transforms changed, refitting the existing one is enough.
 	if (r->scene->instances_dirty) {
-		logr(info, "%s top-level BVH: ", r->scene->topLevel ? "Updating" : "Computing");
-		if (r->scene->topLevel) destroy_bvh(r->scene->topLevel);
+		const struct instance_arr instances = scene_traced_instances(r->scene);
 		struct timeval bvh_timer = {0};
 		timer_start(&bvh_timer);
-		r->scene->topLevel = build_top_level_bvh(r->scene->instances);
+		if (r->scene->topLevel && refit_top_level_bvh(r->scene->topLevel, instances)) {
+			logr(info, "Refitting top-level BVH: ");
+		} else {
+			logr(info, "%s top-level BVH: ", r->scene->topLevel ? "Updating" : "Computing");
+			if (r->scene->topLevel) destroy_bvh(r->scene->topLevel);
+			r->scene->topLevel = build_top_level_bvh(instances, r->prefs.bvh_params.builder, r->state.pool);
+		}
 		printSmartTime(timer_get_ms(bvh_timer));
 		logr(plain, "\n");
 		r->scene->instances_dirty = false;
 	}
 
+	if (flattened && r->scene->flat) {
+		logr(info, "Flattened %zu instances into one mesh\n", r->scene->flat->merged_count);
+		// The cost without flattening takes another top-level build to tell
+		if (log_level_get() >= Debug) {
+			struct bvh *unflattened = build_top_level_bvh(r->scene->instances, r->prefs.bvh_params.builder, r->state.pool);
+			logr(debug, "Top-level SAH cost %.2f -> %.2f with flattening\n",
+				(double)get_top_level_sah_cost(unflattened, r->scene->instances),
+				(double)get_top_level_sah_cost(r->scene->topLevel, r->scene->flat->instances));
+			destroy_bvh(unflattened);
+		}
+	}
+
 	print_stats(r->scene);
 
 	for (size_t i = 0; i < set.tiles.count; ++i)
@@ -197,7 +302,8 @@ void renderer_render(struct renderer *r) {
 
 	// Render buffer is used to store accurate color values for the renderers' internal use
 	if (!r->state.result_buf) {
-		// Allocate
+		// Allocate. The pages only get placed in memory once first written, which render threads do
+		// tile by tile. With pinned threads, each part ends up on the NUMA node that renders it.
 		r->state.result_buf = newTexture(float_p, camera->width, camera->height, 4);
 	} else if (r->state.result_buf->width != (size_t)camera->width || r->state.result_buf->height != (size_t)camera->height) {
 		// Resize
@@ -237,14 +343,22 @@ void renderer_render(struct renderer *r) {
 	
 	// Create & boot workers (Nonblocking)
 	// Local render threads + one thread for every client
+	r->state.workers.count = 0;
+	const struct sys_topology *topology = &r->state.topology;
+	const bool pin = r->prefs.pin_threads && topology->cpu_count;
+	if (pin) {
+		logr(info, "Pinning render threads to %zu CPU%s, %zu physical core%s on %zu NUMA node%s\n",
+			topology->cpu_count, PLURAL(topology->cpu_count),
+			topology->physical_cores, PLURAL(topology->physical_cores),
+			topology->numa_nodes, PLURAL(topology->numa_nodes));
+	}
 	for (size_t t = 0; t < r->prefs.threads; ++t) {
 		worker_arr_add(&r->state.workers, (struct worker){
 			.renderer = r,
 			.buf = result,
 			.cam = camera,
-			.thread = (struct cr_thread){
-				.thread_fn = local_render_thread,
-			}
+			.thread_fn = local_render_thread,
+			.cpu = pin ? topology->cpus[t % topology->cpu_count] : -1
 		});
 	}
 	for (size_t c = 0; c < r->state.clients.count; ++c) {
@@ -253,15 +367,16 @@ void renderer_render(struct renderer *r) {
 			.renderer = r,
 			.buf = result,
 			.cam = camera,
-			.thread = (struct cr_thread){
-				.thread_fn = client_connection_thread
-			}
+			.thread_fn = client_connection_thread,
+			.cpu = -1
 		});
 	}
+	// Workers run until the render is done, so each one needs a pool thread of its own
+	thread_pool_reserve(r->state.pool, r->state.workers.count);
+	struct cr_task_group worker_tasks = { 0 };
 	for (size_t w = 0; w < r->state.workers.count; ++w) {
-		r->state.workers.items[w].thread.user_data = &r->state.workers.items[w];
 		r->state.workers.items[w].tiles = &set;
-		if (thread_start(&r->state.workers.items[w].thread))
+		if (!thread_pool_enqueue_group(r->state.pool, &worker_tasks, worker_task, &r->state.workers.items[w]))
 			logr(error, "Failed to start worker %zu\n", w);
 	}
 
@@ -287,11 +402,11 @@ void renderer_render(struct renderer *r) {
 	}
 
 	r->state.current_set = NULL;
+	// Interactive render threads may be waiting for a restart
+	tile_set_wake(&set);
 	
 	//Make sure render threads are terminated before continuing (This blocks)
-	for (size_t w = 0; w < r->state.workers.count; ++w) {
-		thread_wait(&r->state.workers.items[w].thread);
-	}
+	thread_pool_wait_group(r->state.pool, &worker_tasks);
 	struct callback stop = r->state.callbacks[cr_cb_on_stop];
 	if (stop.fn) {
 		update_cb_info(r, &set, &cb_info);
@@ -299,83 +414,169 @@ void renderer_render(struct renderer *r) {
 	}
 	if (info_tiles) free(info_tiles);
 	tile_set_free(&set);
+	r->scene->pool = r->state.pool;
 	logr(info, "Renderer exiting\n");
 	r->state.exit_done = true;
 }
 
 // An interactive render thread that progressively
 // renders samples up to a limit
+// Interactive passes take one sample of each pixel, which goes right into the running average in buf
+static void add_interactive_sample(struct texture *buf, int x, int y, struct color sample, size_t pass) {
+	struct color output = textureGetPixel(buf, x, y, false);
+
+	nan_clamp(&sample, &output);
+	
+	//And process the running average
+	output = colorCoef((float)(pass - 1), output);
+	output = colorAdd(output, sample);
+	float t = 1.0f / pass;
+	output = colorCoef(t, output);
+	
+	//Store internal render buffer (float precision)
+	setPixel(buf, output, x, y);
+}
+
+static void trace_interactive_wave(struct renderer *r, struct wavefront *wave, struct texture *buf, const uint32_t *pixels, size_t count, size_t pass) {
+	wavefront_trace(wave, count, r->scene, r->prefs.bounces);
+	for (size_t i = 0; i < count; ++i)
+		add_interactive_sample(buf, (int)(pixels[i] % buf->width), (int)(pixels[i] / buf->width), wave->radiance[i], pass);
+}
+
+// Takes sample `pass` of each pixel of the tile with the wavefront integrator. Returns false if the render was aborted.
+static bool render_tile_interactive_wavefront(struct renderer *r, struct wavefront *wave, const struct render_tile *tile, struct camera *cam, struct texture *buf, size_t pass) {
+	uint32_t pixels[WAVEFRONT_SIZE];
+	size_t count = 0;
+	for (int y = tile->end.y - 1; y > tile->begin.y - 1; --y) {
+		for (int x = tile->begin.x; x < tile->end.x; ++x) {
+			uint32_t pixIdx = (uint32_t)(y * buf->width + x);
+			initSampler(wave->samplers[count], r->prefs.sampler, pass, r->prefs.sampleCount, pixIdx);
+			wave->incident[count] = cam_get_ray(cam, x, y, wave->samplers[count]);
+			pixels[count++] = pixIdx;
+			if (count < WAVEFRONT_SIZE) continue;
+			if (r->state.render_aborted) return false;
+			trace_interactive_wave(r, wave, buf, pixels, count, pass);
+			count = 0;
+		}
+	}
+	if (r->state.render_aborted) return false;
+	if (count) trace_interactive_wave(r, wave, buf, pixels, count, pass);
+	return true;
+}
+
 void *render_thread_interactive(void *arg) {
 	block_signals();
 	struct worker *threadState = arg;
 	threadState->in_pause_loop = false;
 	struct renderer *r = threadState->renderer;
 	struct texture **buf = threadState->buf;
-	sampler *sampler = newSampler();
+	sampler *samplers[RAY_PACKET_SIZE];
+	for (size_t i = 0; i < RAY_PACKET_SIZE; ++i)
+		samplers[i] = newSampler();
+	struct wavefront *wave = r->prefs.integrator == integrator_wavefront ? wavefront_new() : NULL;
 
 	struct camera *cam = threadState->cam;
 	
-	//First time setup for each thread
-	struct render_tile *tile = tile_next_interactive(r, threadState->tiles);
-	threadState->currentTile = tile;
-	
+	size_t pass = 0;
+	size_t generation = 0;
+	struct render_tile *tile = NULL;
 	struct timeval timer = {0};
 	
-	while (tile && r->state.rendering) {
+	while (r->state.rendering && !r->state.render_aborted) {
+		//Pause rendering when bool is set
+		while (threadState->paused && !r->state.render_aborted) {
+			threadState->in_pause_loop = true;
+			// Short, as restarts pause too
+			timer_sleep_ms(10);
+		}
+		threadState->in_pause_loop = false;
+		// A tile handed out before a restart during the pause was handed out again since
+		if (tile && tile_set_restarted(threadState->tiles, generation)) tile = NULL;
+		// In case we got NULL back because we were paused:
+		if (!tile) tile = tile_next_interactive(r, threadState->tiles, &pass, &generation);
+		threadState->currentTile = tile;
+		if (!tile) continue;
+
 		long total_us = 0;
 
 		timer_start(&timer);
-		for (int y = tile->end.y - 1; y > tile->begin.y - 1; --y) {
-			for (int x = tile->begin.x; x < tile->end.x; ++x) {
+		if (wave && !render_tile_interactive_wavefront(r, wave, tile, cam, *buf, pass)) goto exit;
+		for (int y = tile->end.y - 1; y > tile->begin.y - 1 && !wave; --y) {
+			for (int x0 = tile->begin.x; x0 < tile->end.x; x0 += RAY_PACKET_SIZE) {
 				if (r->state.render_aborted) goto exit;
-				uint32_t pixIdx = (uint32_t)(y * (*buf)->width + x);
-				//FIXME: This does not converge to the same result as with regular renderThread.
-				//I assume that's because we'd have to init the sampler differently when we render all
-				//the tiles in one go per sample, instead of the other way around.
-				initSampler(sampler, SAMPLING_STRATEGY, r->state.finishedPasses, r->prefs.sampleCount, pixIdx);
-				
-				struct color output = textureGetPixel(*buf, x, y, false);
-				struct color sample = path_trace(cam_get_ray(cam, x, y, sampler), r->scene, r->prefs.bounces, sampler);
-
-				nan_clamp(&sample, &output);
-				
-				//And process the running average
-				output = colorCoef((float)(r->state.finishedPasses - 1), output);
-				output = colorAdd(output, sample);
-				float t = 1.0f / r->state.finishedPasses;
-				output = colorCoef(t, output);
-				
-				//Store internal render buffer (float precision)
-				setPixel(*buf, output, x, y);
+				// Camera rays of neighbouring pixels are traced together as a packet
+				const size_t count = min(RAY_PACKET_SIZE, tile->end.x - x0);
+				struct lightRay rays[RAY_PACKET_SIZE];
+				struct color samples[RAY_PACKET_SIZE];
+				for (size_t i = 0; i < count; ++i) {
+					uint32_t pixIdx = (uint32_t)(y * (*buf)->width + x0 + (int)i);
+					//FIXME: This does not converge to the same result as with regular renderThread.
+					//I assume that's because we'd have to init the sampler differently when we render all
+					//the tiles in one go per sample, instead of the other way around.
+					initSampler(samplers[i], r->prefs.sampler, pass, r->prefs.sampleCount, pixIdx);
+					rays[i] = cam_get_ray(cam, x0 + (int)i, y, samplers[i]);
+				}
+				path_trace_packet(rays, count, r->scene, r->prefs.bounces, samplers, samples);
+
+				for (size_t i = 0; i < count; ++i)
+					add_interactive_sample(*buf, x0 + (int)i, y, samples[i], pass);
 			}
 		}
 		//For performance metrics
 		total_us += timer_get_us(timer);
 		threadState->totalSamples++;
-		threadState->avg_per_sample_us = total_us / r->state.finishedPasses;
+		threadState->avg_per_sample_us = total_us / pass;
 		
 		//Tile has finished rendering, get a new one and start rendering it.
-		tile->state = finished;
+		tile_finish_interactive(r, threadState->tiles, tile, pass, generation);
 		threadState->currentTile = NULL;
-		tile = tile_next_interactive(r, threadState->tiles);
-		//Pause rendering when bool is set
-		while (threadState->paused && !r->state.render_aborted) {
-			threadState->in_pause_loop = true;
-			timer_sleep_ms(100);
-		}
-		threadState->in_pause_loop = false;
-		// In case we got NULL back because we were paused:
-		if (!tile) tile = tile_next_interactive(r, threadState->tiles);
-		threadState->currentTile = tile;
+		tile = tile_next_interactive(r, threadState->tiles, &pass, &generation);
 	}
 exit:
-	destroySampler(sampler);
+	wavefront_destroy(wave);
+	for (size_t i = 0; i < RAY_PACKET_SIZE; ++i)
+		destroySampler(samplers[i]);
 	//No more tiles to render, exit thread. (render done)
 	threadState->thread_complete = true;
 	threadState->currentTile = NULL;
 	return 0;
 }
 
+static void trace_wave(struct renderer *r, struct wavefront *wave, struct film *film, const uint32_t *pixels, size_t count) {
+	wavefront_trace(wave, count, r->scene, r->prefs.bounces);
+	for (size_t i = 0; i < count; ++i)
+		film_add(film, pixels[i] % film->width, pixels[i] / film->width, wave->radiance[i]);
+}
+
+// Takes samples first to first + batch - 1 of each pixel of the tile that hasn't converged yet,
+// with the wavefront integrator. Returns false if the render was aborted.
+static bool render_tile_wavefront(struct renderer *r, struct wavefront *wave, struct film *film, const struct render_tile *tile, struct camera *cam, const struct texture *buf, size_t first, size_t batch) {
+	// Film index of each path in the wave. Samples of a pixel go into the wave in order,
+	// so they reach the film in the same order as with path_trace_packet()
+	uint32_t pixels[WAVEFRONT_SIZE];
+	size_t count = 0;
+	for (size_t b = 0; b < batch; ++b) {
+		for (int y = tile->end.y - 1; y > tile->begin.y - 1; --y) {
+			const unsigned fy = y - tile->begin.y;
+			for (unsigned fx = 0; fx < tile->width; ++fx) {
+				if (film_converged(film, fx, fy)) continue;
+				const int x = tile->begin.x + (int)fx;
+				uint32_t pixIdx = (uint32_t)(y * buf->width + x);
+				initSampler(wave->samplers[count], r->prefs.sampler, first + b, r->prefs.sampleCount, pixIdx);
+				wave->incident[count] = cam_get_ray(cam, x, y, wave->samplers[count]);
+				pixels[count++] = (uint32_t)film_index(film, fx, fy);
+				if (count < WAVEFRONT_SIZE) continue;
+				if (r->state.render_aborted) return false;
+				trace_wave(r, wave, film, pixels, count);
+				count = 0;
+			}
+		}
+	}
+	if (r->state.render_aborted) return false;
+	if (count) trace_wave(r, wave, film, pixels, count);
+	return true;
+}
+
 /**
  A render thread
  
@@ -387,7 +588,10 @@ void *render_thread(void *arg) {
 	struct worker *threadState = arg;
 	struct renderer *r = threadState->renderer;
 	struct texture **buf = threadState->buf;
-	sampler *sampler = newSampler();
+	sampler *samplers[RAY_PACKET_SIZE];
+	for (size_t i = 0; i < RAY_PACKET_SIZE; ++i)
+		samplers[i] = newSampler();
+	struct wavefront *wave = r->prefs.integrator == integrator_wavefront ? wavefront_new() : NULL;
 
 	struct camera *cam = threadState->cam;
 
@@ -397,39 +601,61 @@ void *render_thread(void *arg) {
 	
 	struct timeval timer = { 0 };
 	size_t samples = 1;
+	// First touched by this thread, so the film is on its NUMA node when pinned
+	struct film film = { 0 };
+	const bool adaptive = r->prefs.noise_threshold > 0.0f;
+	const size_t min_samples = adaptive ? adaptive_min_samples(r->prefs.noise_threshold) : 0;
 	
 	while (tile && r->state.rendering) {
 		long total_us = 0;
+		film_reset(&film, tile->width, tile->height);
+		const size_t pixels = (size_t)tile->width * tile->height;
+		size_t active = pixels;
+		// What the tile takes without adaptive sampling, which spreads it over the pixels that still need it
+		size_t budget = pixels * r->prefs.sampleCount;
+		size_t batch;
 		
-		while (samples < r->prefs.sampleCount + 1 && r->state.rendering) {
+		// Take a few samples per pixel back to back, and only then publish their averages
+		while ((batch = film_next_batch(budget, active, FILM_PUBLISH_SAMPLES)) && r->state.rendering) {
 			timer_start(&timer);
-			for (int y = tile->end.y - 1; y > tile->begin.y - 1; --y) {
-				for (int x = tile->begin.x; x < tile->end.x; ++x) {
-					if (r->state.render_aborted) goto exit;
-					uint32_t pixIdx = (uint32_t)(y * (*buf)->width + x);
-					initSampler(sampler, SAMPLING_STRATEGY, samples - 1, r->prefs.sampleCount, pixIdx);
-					
-					struct color output = textureGetPixel(*buf, x, y, false);
-					struct color sample = path_trace(cam_get_ray(cam, x, y, sampler), r->scene, r->prefs.bounces, sampler);
-					
-					// Clamp out fireflies - This is probably not a good way to do that.
-					nan_clamp(&sample, &output);
-
-					//And process the running average
-					output = colorCoef((float)(samples - 1), output);
-					output = colorAdd(output, sample);
-					float t = 1.0f / samples;
-					output = colorCoef(t, output);
-					
-					//Store internal render buffer (float precision)
-					setPixel(*buf, output, x, y);
+			if (wave && !render_tile_wavefront(r, wave, &film, tile, cam, *buf, samples - 1, batch)) goto exit;
+			for (int y = tile->end.y - 1; y > tile->begin.y - 1 && !wave; --y) {
+				const unsigned fy = y - tile->begin.y;
+				for (unsigned fx = 0; fx < tile->width;) {
+					// Camera rays of neighbouring pixels are traced together as a packet, converged pixels are skipped
+					unsigned xs[RAY_PACKET_SIZE];
+					size_t count = 0;
+					for (; fx < tile->width && count < RAY_PACKET_SIZE; ++fx)
+						if (!film_converged(&film, fx, fy)) xs[count++] = fx;
+					if (!count) continue;
+					for (size_t b = 0; b < batch; ++b) {
+						if (r->state.render_aborted) goto exit;
+						struct lightRay rays[RAY_PACKET_SIZE];
+						struct color packet_samples[RAY_PACKET_SIZE];
+						for (size_t i = 0; i < count; ++i) {
+							const int x = tile->begin.x + (int)xs[i];
+							uint32_t pixIdx = (uint32_t)(y * (*buf)->width + x);
+							initSampler(samplers[i], r->prefs.sampler, film_count(&film, xs[i], fy), r->prefs.sampleCount, pixIdx);
+							rays[i] = cam_get_ray(cam, x, y, samplers[i]);
+						}
+						path_trace_packet(rays, count, r->scene, r->prefs.bounces, samplers, packet_samples);
+
+						for (size_t i = 0; i < count; ++i)
+							film_add(&film, xs[i], fy, packet_samples[i]);
+					}
 				}
 			}
+			//Store internal render buffer (float precision)
+			film_publish(&film, *buf, tile->begin.x, tile->begin.y);
 			//For performance metrics
 			total_us += timer_get_us(timer);
-			threadState->totalSamples++;
-			samples++;
-			tile->completed_samples++;
+			threadState->totalSamples += batch;
+			samples += batch;
+			budget -= active * batch;
+			// Progress in samples per pixel, averaged over the tile
+			cr_atomic_store(&tile->completed_samples, r->prefs.sampleCount - (budget + pixels - 1) / pixels);
+			if (adaptive && samples - 1 >= min_samples)
+				active = film_update_convergence(&film, r->prefs.noise_threshold);
 			//Pause rendering when bool is set
 			while (threadState->paused && !r->state.render_aborted) {
 				timer_sleep_ms(100);
@@ -437,6 +663,8 @@ void *render_thread(void *arg) {
 			threadState->avg_per_sample_us = total_us / samples;
 		}
 		//Tile has finished rendering, get a new one and start rendering it.
+		// If it converged early or has a few samples left over, what it got is all it takes.
+		if (r->state.rendering) cr_atomic_store(&tile->total_samples, cr_atomic_load(&tile->completed_samples));
 		tile->state = finished;
 		threadState->currentTile = NULL;
 		samples = 1;
@@ -444,7 +672,10 @@ void *render_thread(void *arg) {
 		threadState->currentTile = tile;
 	}
 exit:
-	destroySampler(sampler);
+	film_free(&film);
+	wavefront_destroy(wave);
+	for (size_t i = 0; i < RAY_PACKET_SIZE; ++i)
+		destroySampler(samplers[i]);
 	//No more tiles to render, exit thread. (render done)
 	threadState->thread_complete = true;
 	threadState->currentTile = NULL;
@@ -454,7 +685,8 @@ exit:
 struct prefs default_prefs(void) {
 	return (struct prefs){
 			.tileOrder = ro_from_middle,
-			.threads = sys_get_cores() + 2,
+			.threads = sys_get_cores(),
+			.sampler = SAMPLING_STRATEGY,
 			.sampleCount = 25,
 			.bounces = 20,
 			.tileWidth = 32,
@@ -469,9 +701,15 @@ struct renderer *renderer_new(void) {
 	struct renderer *r = calloc(1, sizeof(*r));
 	r->prefs = default_prefs();
 	r->state.finishedPasses = 1;
+	r->state.pool = thread_pool_create(sys_get_cores());
+	r->state.topology = sys_get_topology();
+	// One thread per physical core. Threads get placed on those first when pinned, too.
+	if (r->state.topology.physical_cores)
+		r->prefs.threads = r->state.topology.physical_cores;
 	
 	// Move these elsewhere
 	r->scene = calloc(1, sizeof(*r->scene));
+	r->scene->pool = r->state.pool;
 	r->scene->instances_dirty = true;
 	r->scene->asset_path = stringCopy("./");
 	r->scene->storage.node_pool = newBlock(NULL, 1024);
@@ -487,6 +725,10 @@ void renderer_destroy(struct renderer *r) {
 	free(r->prefs.imgFileName);
 	free(r->prefs.imgFilePath);
 	if (r->prefs.node_list) free(r->prefs.node_list);
+	if (r->prefs.bvh_params.cache_path) free(r->prefs.bvh_params.cache_path);
 	if (r->state.result_buf) destroyTexture(r->state.result_buf);
+	// The scene waits for its textures to finish decoding on this first
+	thread_pool_destroy(r->state.pool);
+	sys_topology_free(&r->state.topology);
 	free(r);
 }
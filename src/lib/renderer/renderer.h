@@ -12,10 +12,14 @@
 #include "../datatypes/tile.h"
 #include "../../common/timer.h"
 #include "../../common/platform/thread.h"
+#include "../../common/platform/capabilities.h"
 #include "../protocol/server.h"
+#include "../accelerators/bvh.h"
+#include "samplers/sampler.h"
 
 struct worker {
-	struct cr_thread thread;
+	void *(*thread_fn)(void *); // Runs as a task on the renderer's thread pool
+	int cpu; // Logical CPU to pin the thread to while rendering, or -1
 	bool thread_complete;
 	
 	bool paused; //SDL listens for P key pressed, which sets these, one for each thread.
@@ -54,6 +58,16 @@ struct state {
 
 	struct texture *result_buf;
 	struct tile_set *current_set;
+	// Kept for the lifetime of the renderer, so renders don't start by spawning threads.
+	// BVH builds, texture decoding and render threads all run on this.
+	struct cr_thread_pool *pool;
+	struct sys_topology topology;
+};
+
+/// How the render threads trace their paths
+enum integrator {
+	integrator_path = 0, // One path at a time, see path_trace()
+	integrator_wavefront, // Thousands of paths a bounce at a time, see wavefront.h
 };
 
 /// Preferences data (Set by user)
@@ -76,6 +90,12 @@ struct prefs {
 	char *node_list;
 	bool iterative;
 	bool blender_mode;
+	struct bvh_params bvh_params;
+	bool flatten_scene; // Merge static mesh instances into one mesh, see flatten.h
+	float noise_threshold; // Stop sampling pixels with less noise than this early, and sample noisier ones more instead. 0 disables adaptive sampling
+	bool pin_threads; // Pin each render thread to a CPU, in the order sys_get_topology() gives
+	enum integrator integrator;
+	enum samplerType sampler; // Picked once per render, see sampler.h
 };
 
 struct renderer {
@@ -10,22 +10,12 @@
 #include "halton.h"
 
 #include "common.h"
-#include "../../../common/assert.h"
-#include "../../../common/vector.h"
 
-static const unsigned int primes[] = {2, 3, 5, 7, 11, 13};
-static const unsigned int primesCount = 6;
+const unsigned int halton_primes[6] = {2, 3, 5, 7, 11, 13};
 
 void initHalton(haltonSampler *s, int pass, uint32_t seed) {
 	s->rndOffset = uintToUnitReal(seed);
 	s->currPass = pass;
 	s->currPrime = 0;
-}
-
-float getHalton(haltonSampler *s) {
-	// Wrapping around trick by @lycium
-	float v = wrapAdd(radicalInverse(s->currPass, primes[s->currPrime++ % primesCount]), s->rndOffset);
-	ASSERT(v >= 0.0f);
-	ASSERT(v < 1.0f);
-	return v;
+	initRandom(&s->padding, ((uint64_t)seed << 32) | (uint32_t)pass);
 }
@@ -8,13 +8,31 @@
 
 #pragma once
 
+#include <stdint.h>
+#include "random.h"
+#include "sequence.h"
+#include "../../../common/assert.h"
+
 struct haltonSampler {
 	float rndOffset;
 	unsigned currPrime;
 	int currPass;
+	// Reusing the primes would repeat the same numbers, so the dimensions past them are random
+	randomSampler padding;
 };
 
 typedef struct haltonSampler haltonSampler;
 
 void initHalton(haltonSampler *s, int pass, uint32_t seed);
-float getHalton(haltonSampler *s);
+
+extern const unsigned int halton_primes[6];
+
+static inline float getHalton(haltonSampler *s) {
+	if (s->currPrime >= sizeof(halton_primes) / sizeof(halton_primes[0])) return getRandom(&s->padding);
+	const float u = radicalInverse(s->currPass, halton_primes[s->currPrime++]);
+	// Wrapping around trick by @lycium
+	float v = wrapAdd(u, s->rndOffset);
+	ASSERT(v >= 0.0f);
+	ASSERT(v < 1.0f);
+	return v;
+}
@@ -9,15 +9,37 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+#include "random.h"
+#include "sequence.h"
+#include "../../../common/assert.h"
 
 struct hammersleySampler {
 	float rndOffset;
 	unsigned currPrime;
 	int currPass;
 	int maxPasses;
+	randomSampler padding; // For the dimensions past the primes, see haltonSampler
 };
 
 typedef struct hammersleySampler hammersleySampler;
 
 void initHammersley(hammersleySampler *s, int pass, int maxPasses, uint32_t seed);
-float getHammersley(hammersleySampler *s);
+
+extern const unsigned int hammersley_primes[6];
+
+// Wrong
+static inline float getHammersley(hammersleySampler *s) {
+	if (s->currPrime >= sizeof(hammersley_primes) / sizeof(hammersley_primes[0])) return getRandom(&s->padding);
+	// Wrapping around trick by Thomas Ludwig (@lycium)
+	float u;
+	if (s->currPass > 0) {
+		u = radicalInverse(s->currPass, hammersley_primes[s->currPrime++]);
+	} else {
+		u = s->currPass / s->maxPasses;
+	}
+	const float v = wrapAdd(u, s->rndOffset);
+	ASSERT(v >= 0.0f);
+	ASSERT(v <= 1.0f);
+	return v;
+}
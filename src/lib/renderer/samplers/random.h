@@ -9,6 +9,7 @@
 #pragma once
 
 #include "../../vendored/pcg_basic.h"
+#include "../../../common/assert.h"
 
 struct randomSampler {
 	pcg32_random_t rng;
@@ -18,4 +19,9 @@ typedef struct randomSampler randomSampler;
 
 void initRandom(randomSampler *s, uint64_t seed);
 
-float getRandom(randomSampler *s);
+static inline float getRandom(randomSampler *s) {
+	const float v = (1.0f / (1ull << 32)) * pcg32_random_r(&s->rng);
+	ASSERT(v >= 0);
+	ASSERT(v <= 1);
+	return v;
+}
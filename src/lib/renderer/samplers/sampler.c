@@ -8,52 +8,68 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include "halton.h"
-#include "hammersley.h"
-#include "random.h"
 #include "sampler.h"
 #include "common.h"
 
-struct sampler {
-	enum samplerType type;
-	union {
-		hammersleySampler hammersley;
-		haltonSampler halton;
-		randomSampler random;
-	} sampler;
-};
-
 struct sampler *newSampler() {
 	return calloc(1, sizeof(struct sampler));
 }
 
+static uint32_t pixel_seed(sampler *sampler, uint32_t pixelIndex) {
+	if (!sampler->seeded || sampler->pixel != pixelIndex) {
+		sampler->pixel = pixelIndex;
+		sampler->pixel_seed = hash(pixelIndex);
+		sampler->seeded = true;
+	}
+	return sampler->pixel_seed;
+}
+
 void initSampler(sampler *sampler, enum samplerType type, int pass, int maxPasses, uint32_t pixelIndex) {
 	switch (type) {
 		case Halton:
-			initHalton(&sampler->sampler.halton, pass, hash(pixelIndex));
+			initHalton(&sampler->sampler.halton, pass, pixel_seed(sampler, pixelIndex));
 			sampler->type = Halton;
 			break;
 		case Hammersley:
-			initHammersley(&sampler->sampler.hammersley, pass, maxPasses, hash(pixelIndex));
+			initHammersley(&sampler->sampler.hammersley, pass, maxPasses, pixel_seed(sampler, pixelIndex));
 			sampler->type = Hammersley;
 			break;
 		case Random:
 			initRandom(&sampler->sampler.random, hash64(pixelIndex * maxPasses + pass));
 			sampler->type = Random;
 			break;
+		case Sobol:
+			initSobol(&sampler->sampler.sobol, pass, pixel_seed(sampler, pixelIndex));
+			sampler->type = Sobol;
+			break;
 	}
 }
 
-float getDimension(struct sampler *sampler) {
+void samplerSetBounce(struct sampler *sampler, int bounce) {
+	if (sampler->type == Sobol)
+		sobolSetBounce(&sampler->sampler.sobol, bounce);
+}
+
+// Each case is a plain loop, so the type is only looked at once per call
+void getDimensions(struct sampler *sampler, float *out, size_t count) {
 	switch (sampler->type) {
 		case Hammersley:
-			return getHammersley(&sampler->sampler.hammersley);
+			for (size_t i = 0; i < count; ++i)
+				out[i] = getHammersley(&sampler->sampler.hammersley);
+			break;
 		case Halton:
-			return getHalton(&sampler->sampler.halton);
+			for (size_t i = 0; i < count; ++i)
+				out[i] = getHalton(&sampler->sampler.halton);
+			break;
 		case Random:
-			return getRandom(&sampler->sampler.random);
+			for (size_t i = 0; i < count; ++i)
+				out[i] = getRandom(&sampler->sampler.random);
+			break;
+		case Sobol:
+			for (size_t i = 0; i < count; ++i)
+				out[i] = getSobol(&sampler->sampler.sobol);
+			break;
 	}
-	return 0;
 }
 
 void destroySampler(struct sampler *sampler) {
@@ -9,20 +9,61 @@
 #pragma once
 
 #include <stdint.h>
-
-struct sampler;
-typedef struct sampler sampler;
+#include <stddef.h>
+#include <stdbool.h>
+#include "halton.h"
+#include "hammersley.h"
+#include "random.h"
+#include "sobol.h"
 
 enum samplerType {
 	Halton = 0,
 	Hammersley,
-	Random
+	Random,
+	Sobol,
 };
 
+// Defined here, so that getDimension() can be inlined into its callers
+struct sampler {
+	enum samplerType type;
+	union {
+		hammersleySampler hammersley;
+		haltonSampler halton;
+		randomSampler random;
+		sobolSampler sobol;
+	} sampler;
+	// Hash of the pixel last given to initSampler(), samples of a pixel are usually taken back to back
+	uint32_t pixel;
+	uint32_t pixel_seed;
+	bool seeded;
+};
+typedef struct sampler sampler;
+
 struct sampler *newSampler(void);
 
 void initSampler(struct sampler *sampler, enum samplerType type, int pass, int maxPasses, uint32_t pixelIndex);
 
-float getDimension(struct sampler *sampler);
+/// Moves on to the dimensions reserved for a bounce of the path, before it is traced. Sobol uses this to give
+/// a decision the same dimension in every sample, however many the earlier bounces used. Others ignore it.
+void samplerSetBounce(struct sampler *sampler, int bounce);
+
+/// Fills `out` with the next `count` dimensions, same as calling getDimension() `count` times
+void getDimensions(struct sampler *sampler, float *out, size_t count);
+
+// Still a switch on the type for every dimension, but the getters are inlined into it, so that's
+// a well predicted branch instead of a call. Use getDimensions() for several in a row.
+static inline float getDimension(struct sampler *sampler) {
+	switch (sampler->type) {
+		case Hammersley:
+			return getHammersley(&sampler->sampler.hammersley);
+		case Halton:
+			return getHalton(&sampler->sampler.halton);
+		case Random:
+			return getRandom(&sampler->sampler.random);
+		case Sobol:
+			return getSobol(&sampler->sampler.sobol);
+	}
+	return 0;
+}
 
 void destroySampler(struct sampler *sampler);
@@ -0,0 +1,82 @@
+//
+//  sobol.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include "sequence.h"
+#include "../../../common/assert.h"
+
+// Owen-scrambled Sobol points, after Burley's "Practical Hash-based Owen Scrambling" (JCGT 2020).
+// Dimensions are handed out in padded groups of four: each group is its own 4D Sobol pattern,
+// with the order of its points shuffled and its values scrambled by hashes of the pixel seed,
+// so that groups don't correlate with each other. Each bounce starts a new group, see sobolSetBounce().
+struct sobolSampler {
+	uint32_t seed;
+	uint32_t index;
+	uint32_t dimension;
+	// Of the current group of four dimensions
+	uint32_t group_seed;
+	uint32_t shuffled_index;
+};
+
+typedef struct sobolSampler sobolSampler;
+
+void initSobol(sobolSampler *s, int pass, uint32_t seed);
+void sobolSetBounce(sobolSampler *s, int bounce);
+
+// Direction numbers of the first four Sobol dimensions
+extern const uint32_t sobol_directions[4][32];
+
+static inline uint32_t sobol_reverse_bits(uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+static inline uint32_t sobol_sample(uint32_t index, unsigned dimension) {
+	// The first dimension is the van der Corput sequence
+	if (dimension == 0) return sobol_reverse_bits(index);
+	uint32_t x = 0;
+	for (unsigned bit = 0; bit < 32; ++bit)
+		x ^= sobol_directions[dimension][bit] & (0u - ((index >> bit) & 1u));
+	return x;
+}
+
+// Hash by Nathan Vegdahl, which only ever lets lower bits affect higher ones. With the bits
+// reversed around it, that flips each bit based on the ones above it, which is an Owen scramble.
+static inline uint32_t sobol_scramble(uint32_t x, uint32_t seed) {
+	x = sobol_reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return sobol_reverse_bits(x);
+}
+
+static inline uint32_t sobol_hash_combine(uint32_t seed, uint32_t v) {
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Picks the seed and shuffled index of the group of four dimensions that starts at `dimension`
+void sobolStartGroup(sobolSampler *s, uint32_t dimension);
+
+static inline float getSobol(sobolSampler *s) {
+	const uint32_t dimension = s->dimension++;
+	// Groups always start at a multiple of four, so the shuffled index is kept for the rest of the group
+	if (dimension % 4 == 0)
+		sobolStartGroup(s, dimension);
+	const uint32_t x = sobol_scramble(sobol_sample(s->shuffled_index, dimension % 4), sobol_hash_combine(s->group_seed, dimension));
+	const float v = uintToUnitReal(x);
+	ASSERT(v >= 0.0f);
+	ASSERT(v < 1.0f);
+	return v;
+}
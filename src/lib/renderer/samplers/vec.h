@@ -6,6 +6,8 @@
 //  Copyright © 2023 Valtteri Koskivuori. All rights reserved.
 //
 
+#pragma once
+
 #include "sampler.h"
 #include "../../../common/vector.h"
 
@@ -15,16 +17,38 @@ static inline float rand_in_range(float min, float max, sampler *sampler) {
 }
 
 static inline struct coord coord_on_unit_disc(sampler *sampler) {
-	float r = sqrtf(getDimension(sampler));
-	float theta = rand_in_range(0.0f, 2.0f * PI, sampler);
+	float u[2];
+	getDimensions(sampler, u, 2);
+	float r = sqrtf(u[0]);
+	float theta = u[1] * (2.0f * PI);
 	return (struct coord){r * cosf(theta), r * sinf(theta)};
 }
 
 static inline struct vector vec_on_unit_sphere(sampler *sampler) {
-	const float sample_x = getDimension(sampler);
-	const float sample_y = getDimension(sampler);
+	float u[2];
+	getDimensions(sampler, u, 2);
+	const float sample_x = u[0];
+	const float sample_y = u[1];
 	const float a = sample_x * (2.0f * PI);
 	const float s = 2.0f * sqrtf(max(0.0f, sample_y * (1.0f - sample_y)));
 	return (struct vector){ cosf(a) * s, sinf(a) * s, 1.0f - 2.0f * sample_y };
 }
 
+// Solid angle density of the direction of `center + radius * vec_on_unit_sphere()`, which is how the
+// glossy shaders fuzz their reflections. That's a sphere around the tip of center, picked uniformly by
+// area. A direction hits it at up to two points, and each adds its distance^2 / cosine over the area.
+static inline float pdf_on_sphere_around(struct vector center, float radius, struct vector dir) {
+	const float length = vec_length(center);
+	if (length == 0.0f) return 1.0f / (4.0f * PI);
+	const float r = radius / length;
+	const float b = vec_dot(dir, center) / length;
+	const float discriminant = b * b - 1.0f + r * r;
+	if (discriminant <= 0.0f) return 0.0f;
+	const float root = sqrtf(discriminant);
+	const float t_far = b + root;
+	const float t_near = b - root;
+	float dist_sq = 0.0f;
+	if (t_far > 0.0f) dist_sq += t_far * t_far;
+	if (t_near > 0.0f) dist_sq += t_near * t_near;
+	return dist_sq / (4.0f * PI * r * root);
+}
@@ -0,0 +1,164 @@
+//
+//  wavefront.c
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../includes.h"
+#include "wavefront.h"
+
+#include <float.h>
+#include <stdint.h>
+#include "../datatypes/scene.h"
+#include "../accelerators/bvh.h"
+#include "samplers/sampler.h"
+#include "lights.h"
+#include "../nodes/shaders/background.h"
+#include "../../common/assert.h"
+
+struct wave_path {
+	struct lightRay ray;
+	struct color weight;
+	float bsdf_pdf; // See path_trace()
+};
+
+struct wave_sort_key {
+	uintptr_t bsdf;
+	uint32_t path;
+};
+
+struct wavefront *wavefront_new(void) {
+	struct wavefront *wave = calloc(1, sizeof(*wave));
+	for (size_t i = 0; i < WAVEFRONT_SIZE; ++i)
+		wave->samplers[i] = newSampler();
+	wave->paths = calloc(WAVEFRONT_SIZE, sizeof(*wave->paths));
+	wave->isects = calloc(WAVEFRONT_SIZE, sizeof(*wave->isects));
+	wave->keys = calloc(WAVEFRONT_SIZE, sizeof(*wave->keys));
+	wave->active = calloc(WAVEFRONT_SIZE, sizeof(*wave->active));
+	return wave;
+}
+
+void wavefront_destroy(struct wavefront *wave) {
+	if (!wave) return;
+	for (size_t i = 0; i < WAVEFRONT_SIZE; ++i)
+		destroySampler(wave->samplers[i]);
+	free(wave->paths);
+	free(wave->isects);
+	free(wave->keys);
+	free(wave->active);
+	free(wave);
+}
+
+static inline struct hitRecord empty_isect(struct lightRay *ray) {
+	return (struct hitRecord){ .incident = ray, .instIndex = -1, .distance = FLT_MAX, .polygon = NULL };
+}
+
+// Camera rays are still coherent, so those are traced as packets of neighbouring paths
+static void extend_packets(struct wavefront *wave, size_t count, const struct world *scene) {
+	const struct instance *instances = scene_traced_instances(scene).items;
+	for (size_t first = 0; first < count; first += RAY_PACKET_SIZE) {
+		const size_t n = min(RAY_PACKET_SIZE, count - first);
+		struct lightRay rays[RAY_PACKET_SIZE] = { 0 };
+		struct hitRecord isects[RAY_PACKET_SIZE];
+		sampler *samplers[RAY_PACKET_SIZE];
+		for (size_t i = 0; i < n; ++i) {
+			const uint32_t p = wave->active[first + i];
+			rays[i] = wave->paths[p].ray;
+			isects[i] = empty_isect(&rays[i]);
+			samplers[i] = wave->samplers[p];
+		}
+		traverse_top_level_bvh_packet(instances, scene->topLevel, rays, isects, (1u << n) - 1, samplers);
+		for (size_t i = 0; i < n; ++i) {
+			const uint32_t p = wave->active[first + i];
+			wave->isects[p] = isects[i];
+			wave->isects[p].incident = &wave->paths[p].ray;
+		}
+	}
+}
+
+static void extend(struct wavefront *wave, size_t count, const struct world *scene) {
+	const struct instance *instances = scene_traced_instances(scene).items;
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t p = wave->active[i];
+		wave->isects[p] = empty_isect(&wave->paths[p].ray);
+		traverse_top_level_bvh(instances, scene->topLevel, &wave->paths[p].ray, &wave->isects[p], wave->samplers[p]);
+	}
+}
+
+// Path index breaks ties, so the shading order doesn't depend on the qsort implementation
+static int compare_keys(const void *a, const void *b) {
+	const struct wave_sort_key *ka = a;
+	const struct wave_sort_key *kb = b;
+	if (ka->bsdf != kb->bsdf) return ka->bsdf < kb->bsdf ? -1 : 1;
+	return ka->path < kb->path ? -1 : ka->path > kb->path;
+}
+
+void wavefront_trace(struct wavefront *wave, size_t count, const struct world *scene, int max_bounces) {
+	ASSERT(count <= WAVEFRONT_SIZE);
+	// Generate
+	for (size_t i = 0; i < count; ++i) {
+		wave->paths[i] = (struct wave_path){ .ray = wave->incident[i], .weight = g_white_color };
+		wave->radiance[i] = g_black_color;
+		wave->active[i] = (uint32_t)i;
+	}
+
+	size_t active = count;
+	for (int bounce = 0; bounce <= max_bounces && active; ++bounce) {
+		for (size_t i = 0; i < active; ++i)
+			samplerSetBounce(wave->samplers[wave->active[i]], bounce);
+		if (bounce == 0)
+			extend_packets(wave, active, scene);
+		else
+			extend(wave, active, scene);
+
+		// Misses pick up the background and end here, hits get queued by the shader they hit
+		size_t hits = 0;
+		for (size_t i = 0; i < active; ++i) {
+			const uint32_t p = wave->active[i];
+			const struct hitRecord *isect = &wave->isects[p];
+			if (isect->instIndex < 0) {
+				const struct color background = scene->background->sample(scene->background, wave->samplers[p], isect).weight;
+				wave->radiance[p] = colorAdd(wave->radiance[p], colorMul(wave->paths[p].weight, background));
+				continue;
+			}
+			wave->keys[hits++] = (struct wave_sort_key){ .bsdf = (uintptr_t)isect->bsdf, .path = p };
+		}
+		qsort(wave->keys, hits, sizeof(*wave->keys), compare_keys);
+
+		// Shade, then compact the paths that carry on into the active list
+		active = 0;
+		for (size_t i = 0; i < hits; ++i) {
+			const uint32_t p = wave->keys[i].path;
+			const struct hitRecord *isect = &wave->isects[p];
+			struct wave_path *path = &wave->paths[p];
+			sampler *sampler = wave->samplers[p];
+			const struct bsdfSample sample = isect->bsdf->sample(isect->bsdf, sampler, isect);
+			const float emission_weight = light_mis_weight(scene, isect, path->bsdf_pdf);
+			wave->radiance[p] = colorAdd(wave->radiance[p], colorMul(path->weight, colorCoef(emission_weight, sample.emitted)));
+			if (bounce == max_bounces) continue;
+
+			path->bsdf_pdf = 0.0f;
+			if (scene->lights.lights.count && isect->bsdf->eval) {
+				wave->radiance[p] = colorAdd(wave->radiance[p], colorMul(path->weight, light_sample_direct(scene, isect, sampler)));
+				if (!(sample.out.type & rt_singular))
+					path->bsdf_pdf = isect->bsdf->pdf(isect->bsdf, sampler, isect, vec_normalize(sample.out.direction));
+			}
+
+			path->ray = sample.out;
+			const struct color attenuation = sample.weight;
+
+			// Russian Roulette, same as path_trace()
+			float rr_continue_probability = 1.0f;
+			if (bounce >= 4) {
+				rr_continue_probability = max(attenuation.red, max(attenuation.green, attenuation.blue));
+				if (getDimension(sampler) > rr_continue_probability)
+					continue;
+			}
+
+			path->weight = colorCoef(1.0f / rr_continue_probability, colorMul(attenuation, path->weight));
+			wave->active[active++] = p;
+		}
+	}
+}
@@ -0,0 +1,44 @@
+//
+//  wavefront.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../datatypes/lightray.h"
+#include "../nodes/bsdfnode.h"
+
+struct world;
+struct wave_path;
+struct wave_sort_key;
+
+// Most paths traced together in one wave
+#define WAVEFRONT_SIZE 4096
+
+// A batch of paths that are traced a bounce at a time, instead of one path at a time.
+// Each bounce goes through the same stages for every path still alive: extend them with the
+// BVH, sort the hits by the shader they hit, shade them in that order, then drop the paths
+// Russian roulette ended. Shading runs of paths with the same shader keeps that node graph
+// hot in the caches, where path_trace() jumps between graphs from one ray to the next.
+struct wavefront {
+	// Filled in by the caller, one for each path
+	sampler *samplers[WAVEFRONT_SIZE];
+	struct lightRay incident[WAVEFRONT_SIZE];
+	// Final contribution of each path
+	struct color radiance[WAVEFRONT_SIZE];
+	// Internal state
+	struct wave_path *paths;
+	struct hitRecord *isects;
+	struct wave_sort_key *keys;
+	uint32_t *active;
+};
+
+struct wavefront *wavefront_new(void);
+void wavefront_destroy(struct wavefront *wave);
+
+/// Traces the first `count` incident rays of the wave, and writes their results to wave->radiance.
+/// Gives the same results as calling path_trace() for each incident ray, with its own sampler.
+void wavefront_trace(struct wavefront *wave, size_t count, const struct world *scene, int max_bounces);
@@ -0,0 +1,358 @@
+//
+//  perf_bvh.h
+//  c-ray
+//
+//  Created by Valtteri on 16.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../src/lib/accelerators/bvh.h"
+#include "../../src/lib/datatypes/mesh.h"
+#include "../../src/lib/datatypes/poly.h"
+#include "../../src/lib/datatypes/hitrecord.h"
+#include "../../src/lib/datatypes/sphere.h"
+#include "../../src/lib/vendored/pcg_basic.h"
+#include "../../src/lib/datatypes/scene.h"
+#include "../../src/lib/datatypes/camera.h"
+#include "../../src/lib/renderer/renderer.h"
+#include "../../src/lib/renderer/samplers/sampler.h"
+#include "../../src/common/timer.h"
+#include <c-ray/c-ray.h>
+
+#define PERF_BVH_TRIS 50000
+#define PERF_BVH_RAYS 20000
+#define PERF_CAMERA_WIDTH  320
+#define PERF_CAMERA_HEIGHT 200
+#define PERF_CAMERA_PASSES 4
+#define PERF_SPHERES 100000
+
+static const char *perf_scenes[] = { "input/scene.json", "input/venus.json", "input/statues.json" };
+static const size_t perf_camera_scenes[] = { 0, 1 };
+static const size_t perf_layout_scenes[] = { 1, 2 };
+
+static float perf_bvh_rand(pcg32_random_t *rng) {
+	return (float)ldexp(pcg32_random_r(rng), -32) * 2.0f - 1.0f;
+}
+
+static struct vector perf_bvh_rand_vec(pcg32_random_t *rng, float scale) {
+	return (struct vector){ perf_bvh_rand(rng) * scale, perf_bvh_rand(rng) * scale, perf_bvh_rand(rng) * scale };
+}
+
+static struct mesh perf_bvh_mesh(struct vertex_buffer *vbuf, pcg32_random_t *rng) {
+	struct mesh mesh = { .vbuf = vbuf };
+	for (int i = 0; i < PERF_BVH_TRIS; ++i) {
+		struct vector center = perf_bvh_rand_vec(rng, 10.0f);
+		struct poly p = { 0 };
+		for (int v = 0; v < 3; ++v) {
+			p.vertexIndex[v] = vector_arr_add(&vbuf->vertices, vec_add(center, perf_bvh_rand_vec(rng, 0.2f)));
+			p.textureIndex[v] = -1;
+		}
+		poly_arr_add(&mesh.polygons, p);
+	}
+	return mesh;
+}
+
+// Builds a BVH with the given layout and builder for a random triangle soup, and times tracing rays through it.
+// The memory used by the BVH is printed on the first run.
+static time_t perf_bvh_traverse(enum bvh_layout layout, enum bvh_builder builder, bool *printed) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = perf_bvh_mesh(&vbuf, &rng);
+	mesh.bvh = build_mesh_bvh(&mesh, layout, builder, NULL);
+	if (!*printed) {
+		printf("(%6zu KiB) ", get_bvh_memory_usage(mesh.bvh) / 1024);
+		*printed = true;
+	}
+
+	struct timeval test;
+	timer_start(&test);
+	for (int i = 0; i < PERF_BVH_RAYS; ++i) {
+		struct lightRay ray = {
+			.start = perf_bvh_rand_vec(&rng, 15.0f),
+			.direction = vec_normalize(perf_bvh_rand_vec(&rng, 1.0f)),
+		};
+		struct hitRecord isect = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		traverse_bottom_level_bvh(&mesh, &ray, &isect, NULL);
+	}
+	time_t us = timer_get_us(test);
+
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return us;
+}
+
+time_t bvh_traverse_float(void) {
+	static bool printed = false;
+	return perf_bvh_traverse(bvh_layout_float, bvh_builder_sah, &printed);
+}
+
+time_t bvh_traverse_quantized16(void) {
+	static bool printed = false;
+	return perf_bvh_traverse(bvh_layout_quantized16, bvh_builder_sah, &printed);
+}
+
+time_t bvh_traverse_quantized8(void) {
+	static bool printed = false;
+	return perf_bvh_traverse(bvh_layout_quantized8, bvh_builder_sah, &printed);
+}
+
+time_t bvh_traverse_fast(void) {
+	static bool printed = false;
+	return perf_bvh_traverse(bvh_layout_float, bvh_builder_fast, &printed);
+}
+
+// Times building a BVH for the triangle soup on a single thread, with the given builder
+static time_t perf_bvh_build(enum bvh_builder builder) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = perf_bvh_mesh(&vbuf, &rng);
+	struct timeval test;
+	timer_start(&test);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, builder, NULL);
+	time_t us = timer_get_us(test);
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return us;
+}
+
+time_t bvh_build_sah(void) {
+	return perf_bvh_build(bvh_builder_sah);
+}
+
+time_t bvh_build_fast(void) {
+	return perf_bvh_build(bvh_builder_fast);
+}
+
+// Times refitting the BVH of the triangle soup after moving all vertices slightly.
+// The time it takes to build the BVH is printed on the first run, for comparison.
+time_t bvh_refit_small_motion(void) {
+	static bool printed = false;
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = perf_bvh_mesh(&vbuf, &rng);
+	struct timeval test;
+	timer_start(&test);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	if (!printed) {
+		printf("(build %6lld us) ", (long long)timer_get_us(test));
+		printed = true;
+	}
+
+	for (size_t i = 0; i < vbuf.vertices.count; ++i)
+		vbuf.vertices.items[i] = vec_add(vbuf.vertices.items[i], perf_bvh_rand_vec(&rng, 0.05f));
+	timer_start(&test);
+	refit_mesh_bvh(mesh.bvh, &mesh);
+	time_t us = timer_get_us(test);
+
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return us;
+}
+
+// Times tracing rays through a cloud of small spheres, either with an instance per sphere,
+// or as a single sphere set. The time it takes to build the BVHs is printed on the first run.
+static time_t perf_bvh_spheres(bool as_set, bool *printed) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct sphere_arr spheres = { 0 };
+	struct sphere_set_arr sets = { 0 };
+	struct sphere_set set = { 0 };
+	struct instance_arr instances = { 0 };
+	struct bsdf_buffer bbuf = { 0 };
+	bsdf_node_ptr_arr_add(&bbuf.bsdfs, NULL);
+	struct timeval test;
+	timer_start(&test);
+	if (as_set) {
+		for (int i = 0; i < PERF_SPHERES; ++i) {
+			vector_arr_add(&set.centers, perf_bvh_rand_vec(&rng, 10.0f));
+			float_arr_add(&set.radii, 0.02f);
+		}
+		sphere_set_arr_add(&sets, set);
+		sets.items[0].bvh = build_sphere_set_bvh(&sets.items[0], bvh_layout_float, bvh_builder_sah, NULL);
+		instance_arr_add(&instances, new_sphere_set_instance(&sets, 0));
+	} else {
+		sphere_arr_add(&spheres, (struct sphere){ .radius = 0.02f });
+		for (int i = 0; i < PERF_SPHERES; ++i) {
+			struct instance instance = new_sphere_instance(&spheres, 0, NULL, NULL);
+			const struct vector center = perf_bvh_rand_vec(&rng, 10.0f);
+			instance_set_transform(&instance, tform_new_translate(center.x, center.y, center.z));
+			instance_arr_add(&instances, instance);
+		}
+	}
+	for (size_t i = 0; i < instances.count; ++i)
+		instances.items[i].bbuf = &bbuf;
+	struct bvh *top_level = build_top_level_bvh(instances, bvh_builder_sah, NULL);
+	if (!*printed) {
+		printf("(build %6lld us) ", (long long)timer_get_us(test));
+		*printed = true;
+	}
+
+	timer_start(&test);
+	for (int i = 0; i < PERF_BVH_RAYS; ++i) {
+		struct lightRay ray = {
+			.start = perf_bvh_rand_vec(&rng, 15.0f),
+			.direction = vec_normalize(perf_bvh_rand_vec(&rng, 1.0f)),
+		};
+		struct hitRecord isect = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		traverse_top_level_bvh(instances.items, top_level, &ray, &isect, NULL);
+	}
+	time_t us = timer_get_us(test);
+
+	destroy_bvh(top_level);
+	instance_arr_free(&instances);
+	sets.elem_free = sphere_set_free;
+	sphere_set_arr_free(&sets);
+	sphere_arr_free(&spheres);
+	bsdf_node_ptr_arr_free(&bbuf.bsdfs);
+	return us;
+}
+
+time_t bvh_spheres_instanced(void) {
+	static bool printed = false;
+	return perf_bvh_spheres(false, &printed);
+}
+
+time_t bvh_spheres_set(void) {
+	static bool printed = false;
+	return perf_bvh_spheres(true, &printed);
+}
+
+// Renders a single sample of the given scene to get its BVHs built. Scenes are only loaded once,
+// and kept around for the following runs. Returns NULL if the scene couldn't be loaded.
+static const struct renderer *perf_scene(size_t idx) {
+	static struct cr_renderer *renderers[sizeof(perf_scenes) / sizeof(perf_scenes[0])];
+	static bool loaded[sizeof(perf_scenes) / sizeof(perf_scenes[0])];
+	if (!loaded[idx]) {
+		loaded[idx] = true;
+		enum cr_log_level level = cr_log_level_get();
+		cr_log_level_set(Silent);
+		struct cr_renderer *ext = cr_new_renderer();
+		if (cr_load_json(ext, perf_scenes[idx])) {
+			// Scenes set their own preferences, so these have to be overridden after loading
+			cr_renderer_set_num_pref(ext, cr_renderer_samples, 1);
+			cr_renderer_set_num_pref(ext, cr_renderer_override_width, PERF_CAMERA_WIDTH);
+			cr_renderer_set_num_pref(ext, cr_renderer_override_height, PERF_CAMERA_HEIGHT);
+			cr_renderer_render(ext);
+			renderers[idx] = ext;
+		} else {
+			cr_destroy_renderer(ext);
+		}
+		cr_log_level_set(level);
+	}
+	return (struct renderer *)renderers[idx];
+}
+
+// Times tracing the camera rays of every pixel through the scenes above, either one by one or
+// in packets of neighbouring pixels. The amount of camera rays traced per second is printed on the first run.
+static time_t perf_bvh_camera_rays(bool packets, bool *printed) {
+	const size_t pixels = PERF_CAMERA_WIDTH * PERF_CAMERA_HEIGHT;
+	struct lightRay *rays = calloc(pixels, sizeof(*rays));
+	sampler *samplers[RAY_PACKET_SIZE];
+	sampler *sampler = newSampler();
+	for (size_t i = 0; i < RAY_PACKET_SIZE; ++i)
+		samplers[i] = sampler;
+
+	time_t total_us = 0;
+	size_t ray_count = 0;
+	for (size_t s = 0; s < sizeof(perf_camera_scenes) / sizeof(perf_camera_scenes[0]); ++s) {
+		const struct renderer *r = perf_scene(perf_camera_scenes[s]);
+		if (!r)
+			continue;
+		const struct world *scene = r->scene;
+		const struct camera *cam = &scene->cameras.items[r->prefs.selected_camera];
+		for (int pass = 0; pass < PERF_CAMERA_PASSES; ++pass) {
+			for (size_t i = 0; i < pixels; ++i) {
+				initSampler(sampler, SAMPLING_STRATEGY, pass, PERF_CAMERA_PASSES, (uint32_t)i);
+				rays[i] = cam_get_ray(cam, (int)(i % PERF_CAMERA_WIDTH), (int)(i / PERF_CAMERA_WIDTH), sampler);
+			}
+
+			struct timeval test;
+			timer_start(&test);
+			for (size_t i = 0; i < pixels; i += RAY_PACKET_SIZE) {
+				struct hitRecord isects[RAY_PACKET_SIZE];
+				for (size_t j = 0; j < RAY_PACKET_SIZE; ++j)
+					isects[j] = (struct hitRecord){ .incident = &rays[i + j], .distance = FLT_MAX, .instIndex = -1 };
+				if (packets) {
+					traverse_top_level_bvh_packet(scene_traced_instances(scene).items, scene->topLevel, &rays[i], isects, (1u << RAY_PACKET_SIZE) - 1, samplers);
+				} else {
+					for (size_t j = 0; j < RAY_PACKET_SIZE; ++j)
+						traverse_top_level_bvh(scene_traced_instances(scene).items, scene->topLevel, &rays[i + j], &isects[j], sampler);
+				}
+			}
+			total_us += timer_get_us(test);
+			ray_count += pixels;
+		}
+	}
+	if (!*printed && total_us) {
+		printf("(%6.2f Mrays/s) ", (double)ray_count / (double)total_us);
+		*printed = true;
+	}
+
+	destroySampler(sampler);
+	free(rays);
+	return total_us;
+}
+
+time_t bvh_camera_rays_single(void) {
+	static bool printed = false;
+	return perf_bvh_camera_rays(false, &printed);
+}
+
+time_t bvh_camera_rays_packet(void) {
+	static bool printed = false;
+	return perf_bvh_camera_rays(true, &printed);
+}
+
+// Times tracing rays that bounce off of the first camera hits into random directions, through
+// the scenes above. Unlike camera rays, these touch BVH nodes all over the tree, so this is the
+// one that shows how well the node layout of the BVHs fits in the caches.
+time_t bvh_scene_rays_incoherent(void) {
+	static bool printed = false;
+	const size_t pixels = PERF_CAMERA_WIDTH * PERF_CAMERA_HEIGHT;
+	struct lightRay *rays = calloc(pixels, sizeof(*rays));
+	sampler *sampler = newSampler();
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 4321, 0);
+
+	time_t total_us = 0;
+	size_t ray_count = 0;
+	for (size_t s = 0; s < sizeof(perf_layout_scenes) / sizeof(perf_layout_scenes[0]); ++s) {
+		const struct renderer *r = perf_scene(perf_layout_scenes[s]);
+		if (!r)
+			continue;
+		const struct world *scene = r->scene;
+		const struct camera *cam = &scene->cameras.items[r->prefs.selected_camera];
+		for (int pass = 0; pass < PERF_CAMERA_PASSES; ++pass) {
+			size_t count = 0;
+			for (size_t i = 0; i < pixels; ++i) {
+				initSampler(sampler, SAMPLING_STRATEGY, pass, PERF_CAMERA_PASSES, (uint32_t)i);
+				struct lightRay ray = cam_get_ray(cam, (int)(i % PERF_CAMERA_WIDTH), (int)(i / PERF_CAMERA_WIDTH), sampler);
+				struct hitRecord isect = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+				if (!traverse_top_level_bvh(scene_traced_instances(scene).items, scene->topLevel, &ray, &isect, sampler))
+					continue;
+				struct vector origin = vec_add(ray.start, vec_scale(ray.direction, isect.distance * 0.999f));
+				rays[count++] = (struct lightRay){ .start = origin, .direction = vec_normalize(perf_bvh_rand_vec(&rng, 1.0f)) };
+			}
+
+			struct timeval test;
+			timer_start(&test);
+			for (size_t i = 0; i < count; ++i) {
+				struct hitRecord isect = { .incident = &rays[i], .distance = FLT_MAX, .instIndex = -1 };
+				traverse_top_level_bvh(scene_traced_instances(scene).items, scene->topLevel, &rays[i], &isect, sampler);
+			}
+			total_us += timer_get_us(test);
+			ray_count += count;
+		}
+	}
+	if (!printed && total_us) {
+		printf("(%6.2f Mrays/s) ", (double)ray_count / (double)total_us);
+		printed = true;
+	}
+
+	destroySampler(sampler);
+	free(rays);
+	return total_us;
+}
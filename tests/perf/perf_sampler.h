@@ -0,0 +1,117 @@
+//
+//  perf_sampler.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#include "../../src/lib/renderer/pathtrace.h"
+#include "../../src/lib/renderer/samplers/sampler.h"
+
+// Convergence is measured on every 4th pixel of the perf camera of input/scene.json, both ways.
+// A few fireflies would dominate a single render, so the error is averaged over a few of them.
+#define PERF_SAMPLER_STRIDE 4
+#define PERF_SAMPLER_TRIALS 4
+#define PERF_SAMPLER_REFERENCE_SPP 1024
+#define PERF_SAMPLER_PIXELS 100000
+#define PERF_SAMPLER_DIMENSIONS 16
+
+static const size_t perf_sampler_spp[] = { 1, 4, 16, 64 };
+
+// Averages `spp` paths for each measured pixel. pixel_offset picks another stream of random numbers
+static void perf_sampler_render(const struct renderer *r, enum samplerType type, size_t spp, uint32_t pixel_offset, struct color *out) {
+	const struct world *scene = r->scene;
+	const struct camera *cam = &scene->cameras.items[r->prefs.selected_camera];
+	sampler *sampler = newSampler();
+	size_t p = 0;
+	for (int y = 0; y < PERF_CAMERA_HEIGHT; y += PERF_SAMPLER_STRIDE) {
+		for (int x = 0; x < PERF_CAMERA_WIDTH; x += PERF_SAMPLER_STRIDE) {
+			struct color sum = g_black_color;
+			for (size_t pass = 0; pass < spp; ++pass) {
+				initSampler(sampler, type, (int)pass, (int)spp, (uint32_t)(y * PERF_CAMERA_WIDTH + x) + pixel_offset);
+				const struct color sample = path_trace(cam_get_ray(cam, x, y, sampler), scene, (int)r->prefs.bounces, sampler);
+				// The renderer replaces these with the average so far, leaving them out is close enough here
+				if (sample.red == sample.red && sample.green == sample.green && sample.blue == sample.blue)
+					sum = colorAdd(sum, sample);
+			}
+			out[p++] = colorCoef(1.0f / (float)spp, sum);
+		}
+	}
+	destroySampler(sampler);
+}
+
+// Renders the measured pixels at a few sample counts, and prints the RMSE of each against a
+// high sample count reference. The reference is rendered with the Random sampler, on streams
+// none of the measured renders use. Its own noise adds a little to each RMSE.
+static void perf_sampler_print_convergence(enum samplerType type) {
+	static struct color *reference = NULL;
+	const size_t pixels = ((PERF_CAMERA_WIDTH + PERF_SAMPLER_STRIDE - 1) / PERF_SAMPLER_STRIDE) * ((PERF_CAMERA_HEIGHT + PERF_SAMPLER_STRIDE - 1) / PERF_SAMPLER_STRIDE);
+	const struct renderer *r = perf_scene(0);
+	if (!r)
+		return;
+	if (!reference) {
+		reference = calloc(pixels, sizeof(*reference));
+		perf_sampler_render(r, Random, PERF_SAMPLER_REFERENCE_SPP, PERF_CAMERA_WIDTH * PERF_CAMERA_HEIGHT, reference);
+	}
+	struct color *estimate = calloc(pixels, sizeof(*estimate));
+	printf("(RMSE");
+	for (size_t i = 0; i < sizeof(perf_sampler_spp) / sizeof(perf_sampler_spp[0]); ++i) {
+		double error = 0.0;
+		for (uint32_t t = 0; t < PERF_SAMPLER_TRIALS; ++t) {
+			perf_sampler_render(r, type, perf_sampler_spp[i], (t + 2) * PERF_CAMERA_WIDTH * PERF_CAMERA_HEIGHT, estimate);
+			for (size_t p = 0; p < pixels; ++p) {
+				const double dr = estimate[p].red - reference[p].red;
+				const double dg = estimate[p].green - reference[p].green;
+				const double db = estimate[p].blue - reference[p].blue;
+				error += dr * dr + dg * dg + db * db;
+			}
+		}
+		printf(" %zuspp %.4f", perf_sampler_spp[i], sqrt(error / (double)(pixels * 3 * PERF_SAMPLER_TRIALS)));
+	}
+	printf(") ");
+	free(estimate);
+}
+
+// Times drawing a typical amount of dimensions for lots of pixels. The convergence of the sampler
+// is printed on the first run.
+static time_t perf_sampler(enum samplerType type, bool *printed) {
+	if (!*printed) {
+		perf_sampler_print_convergence(type);
+		*printed = true;
+	}
+	sampler *sampler = newSampler();
+	float sum = 0.0f;
+	struct timeval test;
+	timer_start(&test);
+	for (uint32_t i = 0; i < PERF_SAMPLER_PIXELS; ++i) {
+		initSampler(sampler, type, (int)(i & 63), 64, i);
+		for (size_t d = 0; d < PERF_SAMPLER_DIMENSIONS; ++d)
+			sum += getDimension(sampler);
+	}
+	time_t us = timer_get_us(test);
+	// Keeps the loop from being optimized out
+	if (sum < 0.0f) printf("%f", sum);
+	destroySampler(sampler);
+	return us;
+}
+
+time_t sampler_halton(void) {
+	static bool printed = false;
+	return perf_sampler(Halton, &printed);
+}
+
+time_t sampler_hammersley(void) {
+	static bool printed = false;
+	return perf_sampler(Hammersley, &printed);
+}
+
+time_t sampler_random(void) {
+	static bool printed = false;
+	return perf_sampler(Random, &printed);
+}
+
+time_t sampler_sobol(void) {
+	static bool printed = false;
+	return perf_sampler(Sobol, &printed);
+}
@@ -11,6 +11,8 @@ static char *failed_expression;
 // Testable modules
 #include "perf_fileio.h"
 #include "perf_base64.h"
+#include "perf_bvh.h"
+#include "perf_sampler.h"
 
 typedef struct {
 	char *test_name;
@@ -21,6 +23,22 @@ static perf_test perf_tests[] = {
 	{"fileio::load", fileio_load},
 	{"base64::bigfile_encode", base64_bigfile_encode},
 	{"base64::bigfile_decode", base64_bigfile_decode},
+	{"bvh::traverse_float", bvh_traverse_float},
+	{"bvh::traverse_quantized16", bvh_traverse_quantized16},
+	{"bvh::traverse_quantized8", bvh_traverse_quantized8},
+	{"bvh::traverse_fast", bvh_traverse_fast},
+	{"bvh::build_sah", bvh_build_sah},
+	{"bvh::build_fast", bvh_build_fast},
+	{"bvh::refit_small_motion", bvh_refit_small_motion},
+	{"bvh::spheres_instanced", bvh_spheres_instanced},
+	{"bvh::spheres_set", bvh_spheres_set},
+	{"bvh::camera_rays_single", bvh_camera_rays_single},
+	{"bvh::camera_rays_packet", bvh_camera_rays_packet},
+	{"bvh::scene_rays_incoherent", bvh_scene_rays_incoherent},
+	{"sampler::halton", sampler_halton},
+	{"sampler::hammersley", sampler_hammersley},
+	{"sampler::random", sampler_random},
+	{"sampler::sobol", sampler_sobol},
 };
 
 #define perf_test_count (sizeof(perf_tests) / sizeof(perf_test))
@@ -0,0 +1,134 @@
+//
+//  test_bsdf.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/nodes/bsdfnode.h"
+#include "../src/lib/renderer/samplers/sampler.h"
+#include "../src/lib/renderer/samplers/vec.h"
+
+#define BSDF_TEST_SAMPLES 65536
+
+// Lopsided, so a lobe in the wrong place doesn't average out
+static float bsdf_test_weight(struct vector dir) {
+	return 1.0f + dir.x + 0.5f * dir.y * dir.y;
+}
+
+// Integrates against bsdf_test_weight() both ways, by calling sample(), and with eval and pdf. Those get
+// integrated over directions picked evenly and with sample(), combined with the balance heuristic. That only
+// works out if pdf is the density of sample(). Sharp samples are left out, like eval and pdf leave them out.
+static bool bsdf_test_agrees(const struct bsdfNode *bsdf, struct vector incident_dir, struct vector normal) {
+	struct lightRay incident = { .direction = vec_normalize(incident_dir) };
+	const struct hitRecord record = { .incident = &incident, .surfaceNormal = normal, .bsdf = bsdf, .instIndex = -1 };
+	sampler *sampler = newSampler();
+	double sampled = 0.0, evaluated = 0.0, sampled_pdf = 0.0, evaluated_pdf = 0.0;
+	for (int i = 0; i < BSDF_TEST_SAMPLES; ++i) {
+		struct vector dirs[2];
+		size_t count = 0;
+		initSampler(sampler, Halton, i, BSDF_TEST_SAMPLES, 1);
+		const struct bsdfSample sample = bsdf->sample(bsdf, sampler, &record);
+		if (!(sample.out.type & rt_singular)) {
+			dirs[count++] = vec_normalize(sample.out.direction);
+			sampled += sample.weight.red * bsdf_test_weight(dirs[0]);
+			sampled_pdf += bsdf_test_weight(dirs[0]);
+		}
+		dirs[count++] = vec_on_unit_sphere(sampler);
+		for (size_t j = 0; j < count; ++j) {
+			const float pdf = bsdf->pdf(bsdf, sampler, &record, dirs[j]);
+			const double weight = bsdf_test_weight(dirs[j]) / (pdf + 1.0 / (4.0 * PI));
+			evaluated += bsdf->eval(bsdf, sampler, &record, dirs[j]).red * weight;
+			evaluated_pdf += pdf * weight;
+		}
+	}
+	destroySampler(sampler);
+	sampled /= BSDF_TEST_SAMPLES;
+	evaluated /= BSDF_TEST_SAMPLES;
+	sampled_pdf /= BSDF_TEST_SAMPLES;
+	evaluated_pdf /= BSDF_TEST_SAMPLES;
+	test_assert(fabs(sampled - evaluated) <= 0.01 * sampled + 1e-3);
+	test_assert(fabs(sampled_pdf - evaluated_pdf) <= 0.01 * sampled_pdf + 1e-3);
+	return true;
+}
+
+// The reflection of a ray coming in at 45 degrees, plus grazing rays from inside, where glass reflects everything
+bool bsdf_agreement(void) {
+	struct node_storage *s = make_storage();
+	const struct colorNode *color = newConstantTexture(s, (struct color){ 0.8f, 0.8f, 0.8f, 1.0f });
+	const struct colorNode *dark = newConstantTexture(s, (struct color){ 0.3f, 0.3f, 0.3f, 1.0f });
+	const struct valueNode *rough = newConstantValue(s, 0.5f);
+	const struct bsdfNode *metal = newMetal(s, color, rough);
+	const struct bsdfNode *shaders[] = {
+		newDiffuse(s, color),
+		newTranslucent(s, color),
+		newIsotropic(s, color),
+		newEmission(s, color, NULL),
+		newTransparent(s, NULL),
+		metal,
+		newMetal(s, color, newConstantValue(s, 1.5f)),
+		newGlass(s, color, newConstantValue(s, 0.4f), NULL),
+		newPlastic(s, color, rough, NULL),
+		newPlastic(s, color, NULL, NULL),
+		newMix(s, newDiffuse(s, dark), metal, newConstantValue(s, 0.3f)),
+		newAdd(s, newDiffuse(s, dark), metal),
+		newAdd(s, newDiffuse(s, dark), newMetal(s, color, NULL)),
+		newAdd(s, newEmission(s, color, NULL), metal),
+	};
+	const struct vector normal = { 0.0f, 1.0f, 0.0f };
+	for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); ++i) {
+		test_assert(shaders[i]->eval && shaders[i]->pdf);
+		test_assert(bsdf_test_agrees(shaders[i], (struct vector){ 1.0f, -1.0f, 0.0f }, normal));
+		test_assert(bsdf_test_agrees(shaders[i], (struct vector){ 0.0f, 0.2f, 1.0f }, normal));
+	}
+	delete_storage(s);
+	return true;
+}
+
+// Perfect mirrors, smooth glass and see-through surfaces only scatter where sample() says
+bool bsdf_singular(void) {
+	struct node_storage *s = make_storage();
+	const struct colorNode *color = newConstantTexture(s, g_white_color);
+	const struct bsdfNode *shaders[] = {
+		newMetal(s, color, NULL),
+		newGlass(s, color, NULL, NULL),
+		newTransparent(s, NULL),
+	};
+	struct lightRay incident = { .direction = vec_normalize((struct vector){ 1.0f, -1.0f, 0.0f }) };
+	const struct hitRecord record = { .incident = &incident, .surfaceNormal = { 0.0f, 1.0f, 0.0f }, .instIndex = -1 };
+	sampler *sampler = newSampler();
+	for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); ++i) {
+		for (int j = 0; j < 16; ++j) {
+			initSampler(sampler, Random, j, 16, 0);
+			const struct bsdfSample sample = shaders[i]->sample(shaders[i], sampler, &record);
+			test_assert(sample.out.type & rt_singular);
+			const struct vector dir = vec_normalize(sample.out.direction);
+			test_assert(shaders[i]->pdf(shaders[i], sampler, &record, dir) == 0.0f);
+			const struct color f = shaders[i]->eval(shaders[i], sampler, &record, dir);
+			test_assert(f.red == 0.0f && f.green == 0.0f && f.blue == 0.0f);
+		}
+	}
+	destroySampler(sampler);
+	delete_storage(s);
+	return true;
+}
+
+// Principled shaders add their emission on top, which needs to show up
+bool bsdf_add_emission(void) {
+	struct node_storage *s = make_storage();
+	const struct bsdfNode *emission = newEmission(s, newConstantTexture(s, g_white_color), newConstantValue(s, 2.0f));
+	const struct bsdfNode *add = newAdd(s, emission, newDiffuse(s, newConstantTexture(s, g_white_color)));
+	test_assert(add->emitted);
+	struct lightRay incident = { .direction = { 0.0f, -1.0f, 0.0f } };
+	const struct hitRecord record = { .incident = &incident, .surfaceNormal = { 0.0f, 1.0f, 0.0f }, .instIndex = -1 };
+	sampler *sampler = newSampler();
+	initSampler(sampler, Random, 0, 1, 0);
+	roughly_equals(add->sample(add, sampler, &record).emitted.red, 2.0f);
+	roughly_equals(add->emitted(add, sampler, &record).red, 2.0f);
+	destroySampler(sampler);
+	delete_storage(s);
+	return true;
+}
@@ -0,0 +1,442 @@
+//
+//  test_bvh.h
+//  c-ray
+//
+//  Created by Valtteri on 16.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include <float.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <c-ray/c-ray.h>
+#include "../src/lib/accelerators/bvh.h"
+#include "../src/lib/accelerators/bvh_cache.h"
+#include "../src/lib/datatypes/mesh.h"
+#include "../src/lib/datatypes/poly.h"
+#include "../src/lib/datatypes/sphere.h"
+#include "../src/lib/datatypes/bbox.h"
+#include "../src/lib/datatypes/hitrecord.h"
+#include "../src/lib/datatypes/scene.h"
+#include "../src/lib/accelerators/flatten.h"
+#include "../src/lib/vendored/pcg_basic.h"
+#include "../src/common/platform/thread_pool.h"
+
+#define BVH_TEST_TRIS 2000
+#define BVH_TEST_RAYS 2000
+#define BVH_TEST_PARALLEL_TRIS 40000
+
+static float bvh_test_rand(pcg32_random_t *rng) {
+	return (float)ldexp(pcg32_random_r(rng), -32);
+}
+
+static struct vector bvh_test_rand_vec(pcg32_random_t *rng, float scale) {
+	return (struct vector){
+		(bvh_test_rand(rng) * 2.0f - 1.0f) * scale,
+		(bvh_test_rand(rng) * 2.0f - 1.0f) * scale,
+		(bvh_test_rand(rng) * 2.0f - 1.0f) * scale,
+	};
+}
+
+// A soup of small, randomly placed triangles, with a few long and thin ones mixed in
+static struct mesh bvh_test_mesh(struct vertex_buffer *vbuf, pcg32_random_t *rng, int tris) {
+	struct mesh mesh = { .vbuf = vbuf };
+	for (int i = 0; i < tris; ++i) {
+		struct vector center = bvh_test_rand_vec(rng, 10.0f);
+		float size = i % 50 ? 0.5f : 8.0f;
+		struct poly p = { 0 };
+		for (int v = 0; v < 3; ++v) {
+			p.vertexIndex[v] = vector_arr_add(&vbuf->vertices, vec_add(center, bvh_test_rand_vec(rng, size)));
+			p.textureIndex[v] = -1;
+		}
+		poly_arr_add(&mesh.polygons, p);
+	}
+	return mesh;
+}
+
+static struct lightRay bvh_test_ray(pcg32_random_t *rng) {
+	return (struct lightRay){
+		.start = bvh_test_rand_vec(rng, 15.0f),
+		.direction = vec_normalize(bvh_test_rand_vec(rng, 1.0f)),
+	};
+}
+
+// Compares BVH traversal against testing every single polygon of the mesh
+static bool bvh_matches_brute_force(const struct mesh *mesh, pcg32_random_t *rng) {
+	for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+		struct lightRay ray = bvh_test_ray(rng);
+		struct hitRecord expected = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		for (size_t p = 0; p < mesh->polygons.count; ++p) {
+			rayIntersectsWithPolygon(mesh, &ray, &mesh->polygons.items[p], &expected);
+		}
+		struct hitRecord actual = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		traverse_bottom_level_bvh(mesh, &ray, &actual, NULL);
+		if (expected.distance != actual.distance) return false;
+	}
+	return true;
+}
+
+bool bvh_traversal(void) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	test_assert(mesh.bvh);
+	test_assert(bvh_matches_brute_force(&mesh, &rng));
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return true;
+}
+
+// A mesh large enough to be built in parallel has to result in the exact same BVH as a serial build
+bool bvh_parallel_build(void) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 4321, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_PARALLEL_TRIS);
+	struct mesh parallel_mesh = mesh;
+
+	struct cr_thread_pool *pool = thread_pool_create(4);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	parallel_mesh.bvh = build_mesh_bvh(&parallel_mesh, bvh_layout_float, bvh_builder_sah, pool);
+	thread_pool_destroy(pool);
+	test_assert(mesh.bvh && parallel_mesh.bvh);
+
+	struct boundingBox serial_bbox = get_root_bbox(mesh.bvh);
+	struct boundingBox parallel_bbox = get_root_bbox(parallel_mesh.bvh);
+	test_assert(vec_equals(serial_bbox.min, parallel_bbox.min));
+	test_assert(vec_equals(serial_bbox.max, parallel_bbox.max));
+
+	for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+		struct lightRay ray = bvh_test_ray(&rng);
+		struct hitRecord serial = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		struct hitRecord parallel = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		traverse_bottom_level_bvh(&mesh, &ray, &serial, NULL);
+		traverse_bottom_level_bvh(&parallel_mesh, &ray, &parallel, NULL);
+		test_assert(serial.distance == parallel.distance);
+		test_assert(serial.polygon == parallel.polygon);
+	}
+
+	destroy_bvh(parallel_mesh.bvh);
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return true;
+}
+
+bool bvh_spatial_splits(void) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+	mesh.spatial_split_budget = 0.5f;
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	test_assert(mesh.bvh);
+	test_assert(bvh_matches_brute_force(&mesh, &rng));
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return true;
+}
+
+// The fast builder has to find the same hits as brute force, and a parallel build has to match a serial one
+bool bvh_fast_builder(void) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_fast, NULL);
+	test_assert(mesh.bvh);
+	test_assert(bvh_matches_brute_force(&mesh, &rng));
+	mesh_free(&mesh);
+
+	mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_PARALLEL_TRIS);
+	struct mesh parallel_mesh = mesh;
+	struct cr_thread_pool *pool = thread_pool_create(4);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_fast, NULL);
+	parallel_mesh.bvh = build_mesh_bvh(&parallel_mesh, bvh_layout_float, bvh_builder_fast, pool);
+	thread_pool_destroy(pool);
+	test_assert(mesh.bvh && parallel_mesh.bvh);
+	for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+		struct lightRay ray = bvh_test_ray(&rng);
+		struct hitRecord serial = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		struct hitRecord parallel = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		traverse_bottom_level_bvh(&mesh, &ray, &serial, NULL);
+		traverse_bottom_level_bvh(&parallel_mesh, &ray, &parallel, NULL);
+		test_assert(serial.distance == parallel.distance);
+		test_assert(serial.polygon == parallel.polygon);
+	}
+
+	destroy_bvh(parallel_mesh.bvh);
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return true;
+}
+
+// Compressed layouts have to find the exact same hits, while using less memory
+bool bvh_quantized(void) {
+	const enum bvh_layout layouts[] = { bvh_layout_quantized16, bvh_layout_quantized8 };
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	const size_t float_bytes = get_bvh_memory_usage(mesh.bvh);
+	for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i) {
+		destroy_bvh(mesh.bvh);
+		mesh.bvh = build_mesh_bvh(&mesh, layouts[i], bvh_builder_sah, NULL);
+		test_assert(mesh.bvh);
+		test_assert(get_bvh_memory_usage(mesh.bvh) < float_bytes);
+		test_assert(bvh_matches_brute_force(&mesh, &rng));
+	}
+	mesh_free(&mesh);
+	vertex_buf_free(&vbuf);
+	return true;
+}
+
+// Refitted BVHs have to find the exact same hits as a fresh build after small vertex movements,
+// and have to ask for a rebuild once the triangles have been shuffled around the whole scene.
+bool bvh_refit(void) {
+	const enum bvh_layout layouts[] = { bvh_layout_float, bvh_layout_quantized16, bvh_layout_quantized8 };
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 1234, 0);
+		struct vertex_buffer vbuf = { 0 };
+		struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+		mesh.bvh = build_mesh_bvh(&mesh, layouts[l], bvh_builder_sah, NULL);
+		test_assert(mesh.bvh);
+
+		for (size_t i = 0; i < vbuf.vertices.count; ++i)
+			vbuf.vertices.items[i] = vec_add(vbuf.vertices.items[i], bvh_test_rand_vec(&rng, 0.1f));
+		test_assert(refit_mesh_bvh(mesh.bvh, &mesh));
+		test_assert(bvh_matches_brute_force(&mesh, &rng));
+
+		for (size_t i = 0; i < vbuf.vertices.count; ++i)
+			vbuf.vertices.items[i] = bvh_test_rand_vec(&rng, 10.0f);
+		test_assert(!refit_mesh_bvh(mesh.bvh, &mesh));
+		test_assert(bvh_matches_brute_force(&mesh, &rng));
+
+		mesh_free(&mesh);
+		vertex_buf_free(&vbuf);
+	}
+	return true;
+}
+
+// Cached BVHs have to be usable as-is, and never be used for other triangles or once damaged
+bool bvh_cache(void) {
+	// A directory of our own in the system temp directory, so runs don't share it or litter the working directory
+	char cache_path[256];
+	const char *tmp = getenv("TMPDIR");
+	snprintf(cache_path, sizeof(cache_path), "%s/c-ray-bvh-cache-%ld", tmp ? tmp : "/tmp", (long)getpid());
+	const enum bvh_layout layouts[] = { bvh_layout_float, bvh_layout_quantized8 };
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 1234, 0);
+		struct vertex_buffer vbuf = { 0 };
+		struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+		struct bvh *built = build_mesh_bvh(&mesh, layouts[l], bvh_builder_sah, NULL);
+		const uint64_t key = bvh_cache_key(&mesh, layouts[l], 0.0f);
+		test_assert(key != bvh_cache_key(&mesh, layouts[l], 0.5f));
+		test_assert(bvh_cache_store(cache_path, key, built));
+		destroy_bvh(built);
+
+		mesh.bvh = bvh_cache_load(cache_path, key, &mesh);
+		test_assert(mesh.bvh);
+		test_assert(bvh_matches_brute_force(&mesh, &rng));
+		// Refitting has to work on the read-only mapping too
+		vbuf.vertices.items[0] = vec_add(vbuf.vertices.items[0], (struct vector){ 1.0f, 1.0f, 1.0f });
+		test_assert(refit_mesh_bvh(mesh.bvh, &mesh));
+		test_assert(bvh_matches_brute_force(&mesh, &rng));
+		test_assert(bvh_cache_key(&mesh, layouts[l], 0.0f) != key);
+
+		// Damage the end of the file
+		char path[300];
+		snprintf(path, sizeof(path), "%s/%016llx.bvh", cache_path, (unsigned long long)key);
+		FILE *file = fopen(path, "r+b");
+		test_assert(file);
+		fseek(file, -1, SEEK_END);
+		fputc(0x55, file);
+		fclose(file);
+		test_assert(!bvh_cache_load(cache_path, key, &mesh));
+
+		bvh_cache_evict(cache_path, 0);
+		test_assert(!is_valid_file(path));
+		mesh_free(&mesh);
+		vertex_buf_free(&vbuf);
+	}
+	remove(cache_path);
+	return true;
+}
+
+// Occlusion queries have to agree with the closest hit, for every layout
+bool bvh_occlusion(void) {
+	const enum bvh_layout layouts[] = { bvh_layout_float, bvh_layout_quantized16, bvh_layout_quantized8 };
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 1234, 0);
+		struct vertex_buffer vbuf = { 0 };
+		struct mesh mesh = bvh_test_mesh(&vbuf, &rng, BVH_TEST_TRIS);
+		mesh.bvh = build_mesh_bvh(&mesh, layouts[l], bvh_builder_sah, NULL);
+		test_assert(mesh.bvh);
+		for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+			struct lightRay ray = bvh_test_ray(&rng);
+			struct hitRecord isect = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+			const bool hit = traverse_bottom_level_bvh(&mesh, &ray, &isect, NULL);
+			test_assert(traverse_bottom_level_bvh_occluded(&mesh, &ray, FLT_MAX) == hit);
+			if (hit) {
+				test_assert(!traverse_bottom_level_bvh_occluded(&mesh, &ray, isect.distance * 0.999f));
+				test_assert(traverse_bottom_level_bvh_occluded(&mesh, &ray, isect.distance * 1.001f));
+			}
+		}
+		mesh_free(&mesh);
+		vertex_buf_free(&vbuf);
+	}
+	return true;
+}
+
+// Sphere set leaves are intersected several spheres at a time, which has to agree with testing them one by one
+bool bvh_sphere_set(void) {
+	const enum bvh_builder builders[] = { bvh_builder_sah, bvh_builder_fast };
+	for (size_t b = 0; b < sizeof(builders) / sizeof(builders[0]); ++b) {
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 1234, 0);
+		struct sphere_set set = { 0 };
+		for (int i = 0; i < BVH_TEST_TRIS; ++i) {
+			vector_arr_add(&set.centers, bvh_test_rand_vec(&rng, 10.0f));
+			float_arr_add(&set.radii, i % 50 ? 0.1f + 0.4f * bvh_test_rand(&rng) : 3.0f);
+		}
+		set.bvh = build_sphere_set_bvh(&set, bvh_layout_float, builders[b], NULL);
+		test_assert(set.bvh);
+		for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+			struct lightRay ray = bvh_test_ray(&rng);
+			struct hitRecord expected = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+			size_t expected_idx = set.centers.count;
+			for (size_t s = 0; s < set.centers.count; ++s) {
+				struct lightRay local = { vec_sub(ray.start, set.centers.items[s]), ray.direction };
+				if (rayIntersectsWithSphere(&local, &(struct sphere){ .radius = set.radii.items[s] }, &expected))
+					expected_idx = s;
+			}
+			struct hitRecord actual = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+			const bool hit = traverse_sphere_set_bvh(&set, &ray, &actual);
+			test_assert(hit == (expected_idx != set.centers.count));
+			test_assert(traverse_sphere_set_bvh_occluded(&set, &ray, FLT_MAX) == hit);
+			if (hit) {
+				test_assert(actual.primIndex == expected_idx);
+				test_assert(fabsf(actual.distance - expected.distance) <= 1e-3f * expected.distance);
+				test_assert(!traverse_sphere_set_bvh_occluded(&set, &ray, actual.distance * 0.999f));
+			}
+		}
+		sphere_set_free(&set);
+	}
+	return true;
+}
+
+// Instances can only be made of sphere sets that exist, and those can't be empty
+bool bvh_sphere_set_instance(void) {
+	struct cr_renderer *r = cr_new_renderer();
+	struct cr_scene *scene = cr_renderer_scene_get(r);
+	const struct cr_vector center = { 0.0f, 0.0f, 0.0f };
+	const float radius = 1.0f;
+	test_assert(cr_instance_new(scene, 0, cr_object_sphere_set) == -1);
+	test_assert(cr_scene_add_sphere_set(scene, &center, &radius, 0) == -1);
+	const cr_sphere_set set = cr_scene_add_sphere_set(scene, &center, &radius, 1);
+	test_assert(set == 0);
+	test_assert(cr_instance_new(scene, set + 1, cr_object_sphere_set) == -1);
+	test_assert(cr_instance_new(scene, set, cr_object_sphere_set) == 0);
+	cr_destroy_renderer(r);
+	return true;
+}
+
+// Tracing a flattened scene has to hit the same surfaces, with the same materials
+bool bvh_flatten(void) {
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 1234, 0);
+	struct world scene = { 0 };
+	// The first two meshes share vertices, like meshes loaded from the same file do
+	vertex_buffer_arr_add(&scene.v_buffers, (struct vertex_buffer){ 0 });
+	vertex_buffer_arr_add(&scene.v_buffers, (struct vertex_buffer){ 0 });
+	const size_t vbuf_idx[] = { 0, 0, 1, 1 };
+	for (size_t i = 0; i < 4; ++i) {
+		struct mesh mesh = bvh_test_mesh(&scene.v_buffers.items[vbuf_idx[i]], &rng, BVH_TEST_TRIS / 4);
+		mesh.vbuf_idx = vbuf_idx[i];
+		for (size_t p = 0; p < mesh.polygons.count; ++p)
+			mesh.polygons.items[p].materialIndex = p % 2;
+		mesh_arr_add(&scene.meshes, mesh);
+	}
+	// The bsdfs are only compared, never evaluated
+	for (uintptr_t i = 0; i < 2; ++i) {
+		struct bsdf_buffer bbuf = { 0 };
+		bsdf_node_ptr_arr_add(&bbuf.bsdfs, (const struct bsdfNode *)(4 * i + 8));
+		bsdf_node_ptr_arr_add(&bbuf.bsdfs, (const struct bsdfNode *)(4 * i + 16));
+		bsdf_buffer_arr_add(&scene.shader_buffers, bbuf);
+	}
+	for (size_t i = 0; i < scene.meshes.count; ++i) {
+		scene.meshes.items[i].vbuf = &scene.v_buffers.items[scene.meshes.items[i].vbuf_idx];
+		scene.meshes.items[i].bvh = build_mesh_bvh(&scene.meshes.items[i], bvh_layout_float, bvh_builder_sah, NULL);
+		struct instance instance = new_mesh_instance(&scene.meshes, i, NULL, NULL);
+		instance.bbuf_idx = i % 2;
+		instance_arr_add(&scene.instances, instance);
+	}
+	// This one moves, so it's kept out of the merged mesh
+	instance_set_transform(&scene.instances.items[3], tform_new_translate(1.0f, 2.0f, 3.0f));
+	for (size_t i = 0; i < scene.instances.count; ++i)
+		scene.instances.items[i].bbuf = &scene.shader_buffers.items[scene.instances.items[i].bbuf_idx];
+
+	struct flat_scene *flat = flatten_scene(&scene);
+	test_assert(flat);
+	test_assert(flat->merged_count == 3);
+	test_assert(flat->instances.count == 2);
+	test_assert(flat->bbuf.bsdfs.count == 4);
+	flat->meshes.items[0].bvh = build_mesh_bvh(&flat->meshes.items[0], bvh_layout_float, bvh_builder_sah, NULL);
+	struct bvh *top_level = build_top_level_bvh(scene.instances, bvh_builder_sah, NULL);
+	struct bvh *flat_top_level = build_top_level_bvh(flat->instances, bvh_builder_sah, NULL);
+	test_assert(get_top_level_sah_cost(flat_top_level, flat->instances) > 0.0f);
+
+	for (int i = 0; i < BVH_TEST_RAYS; ++i) {
+		struct lightRay ray = bvh_test_ray(&rng);
+		// Start outside of everything, so that the ray offsets can't skip any surfaces
+		ray.start = vec_sub(ray.start, vec_scale(ray.direction, 50.0f));
+		struct hitRecord expected = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		struct hitRecord actual = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+		const bool hit = traverse_top_level_bvh(scene.instances.items, top_level, &ray, &expected, NULL);
+		test_assert(traverse_top_level_bvh(flat->instances.items, flat_top_level, &ray, &actual, NULL) == hit);
+		if (hit) {
+			test_assert(actual.bsdf == expected.bsdf);
+			test_assert(vec_length(vec_sub(actual.hitPoint, expected.hitPoint)) < 1e-3f);
+		}
+	}
+
+	// Moving the kept instance only needs it copied over, adding one needs a new merge
+	instance_set_transform(&scene.instances.items[3], tform_new_translate(3.0f, 2.0f, 1.0f));
+	test_assert(flat_scene_refresh(flat, &scene));
+	test_assert(flat->instances.items[0].composite.A.mtx[0][3] == 3.0f);
+	test_assert(flat->merged_count == 3);
+	instance_arr_add(&scene.instances, new_mesh_instance(&scene.meshes, 0, NULL, NULL));
+	test_assert(!flat_scene_refresh(flat, &scene));
+
+	destroy_bvh(top_level);
+	destroy_bvh(flat_top_level);
+	destroy_flat_scene(flat);
+	scene.meshes.elem_free = mesh_free;
+	mesh_arr_free(&scene.meshes);
+	scene.v_buffers.elem_free = vertex_buf_free;
+	vertex_buffer_arr_free(&scene.v_buffers);
+	scene.shader_buffers.elem_free = bsdf_buffer_free;
+	bsdf_buffer_arr_free(&scene.shader_buffers);
+	instance_arr_free(&scene.instances);
+	return true;
+}
+
+bool bvh_empty(void) {
+	struct vertex_buffer vbuf = { 0 };
+	struct mesh mesh = { .vbuf = &vbuf };
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	test_assert(mesh.bvh);
+	struct lightRay ray = { .direction = { 0.0f, 0.0f, 1.0f } };
+	struct hitRecord isect = { .incident = &ray, .distance = FLT_MAX, .instIndex = -1 };
+	test_assert(!traverse_bottom_level_bvh(&mesh, &ray, &isect, NULL));
+	test_assert(!traverse_bottom_level_bvh_occluded(&mesh, &ray, FLT_MAX));
+	mesh_free(&mesh);
+	return true;
+}
@@ -0,0 +1,36 @@
+//
+//  test_capabilities.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/common/platform/capabilities.h"
+
+// Two sockets with a NUMA node and two SMT cores each, numbered like Linux does
+bool capabilities_topology_order(void) {
+	struct cpu_info infos[] = {
+		{ .cpu = 0, .node = 0, .package = 0, .core = 0 },
+		{ .cpu = 1, .node = 0, .package = 0, .core = 1 },
+		{ .cpu = 2, .node = 1, .package = 1, .core = 0 },
+		{ .cpu = 3, .node = 1, .package = 1, .core = 1 },
+		{ .cpu = 4, .node = 0, .package = 0, .core = 0 },
+		{ .cpu = 5, .node = 0, .package = 0, .core = 1 },
+		{ .cpu = 6, .node = 1, .package = 1, .core = 0 },
+		{ .cpu = 7, .node = 1, .package = 1, .core = 1 },
+	};
+	struct sys_topology topology = sys_topology_from_cpus(infos, sizeof(infos) / sizeof(infos[0]));
+	test_assert(topology.cpu_count == 8);
+	test_assert(topology.physical_cores == 4);
+	test_assert(topology.numa_nodes == 2);
+
+	// One per physical core first, alternating between the nodes, and the SMT siblings after those
+	const int expected[] = { 0, 2, 1, 3, 4, 6, 5, 7 };
+	for (size_t i = 0; i < topology.cpu_count; ++i)
+		test_assert(topology.cpus[i] == expected[i]);
+	sys_topology_free(&topology);
+	return true;
+}
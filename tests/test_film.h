@@ -0,0 +1,100 @@
+//
+//  test_film.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/renderer/film.h"
+#include "../src/common/texture.h"
+
+// Published pixels are the averages of their own samples, NaN samples count as the average so far
+bool film_average(void) {
+	struct film film = { 0 };
+	film_reset(&film, 3, 2);
+	for (unsigned y = 0; y < 2; ++y) {
+		for (unsigned x = 0; x < 3; ++x) {
+			for (unsigned s = 0; s <= x; ++s)
+				film_add(&film, x, y, (struct color){ (float)s, 1.0f, 0.0f, 1.0f });
+		}
+	}
+	film_add(&film, 2, 1, (struct color){ NAN, 0.0f, 0.0f, 1.0f });
+	test_assert(film_count(&film, 0, 0) == 1);
+	test_assert(film_count(&film, 2, 1) == 4);
+
+	struct texture *tex = newTexture(float_p, 5, 5, 4);
+	film_publish(&film, tex, 2, 3);
+	roughly_equals(textureGetPixel(tex, 2, 3, false).red, 0.0f);
+	roughly_equals(textureGetPixel(tex, 3, 3, false).red, 0.5f);
+	roughly_equals(textureGetPixel(tex, 4, 3, false).red, 1.0f);
+	roughly_equals(textureGetPixel(tex, 4, 4, false).red, 1.0f);
+	roughly_equals(textureGetPixel(tex, 4, 4, false).green, 1.0f);
+	roughly_equals(textureGetPixel(tex, 1, 1, false).red, 0.0f);
+	destroyTexture(tex);
+
+	// Growing the film for a bigger tile starts it over
+	film_reset(&film, 4, 4);
+	test_assert(film_count(&film, 2, 1) == 0);
+	film_free(&film);
+	return true;
+}
+
+// Pixels with a steady value converge, noisy ones keep getting samples
+bool film_convergence(void) {
+	struct film film = { 0 };
+	film_reset(&film, 2, 1);
+	for (unsigned s = 0; s < 64; ++s) {
+		film_add(&film, 0, 0, (struct color){ 0.5f, 0.5f, 0.5f, 1.0f });
+		const float noisy = (s % 4) == 1 ? 4.0f : 0.0f;
+		film_add(&film, 1, 0, (struct color){ noisy, noisy, noisy, 1.0f });
+	}
+	test_assert(film_update_convergence(&film, 0.01f) == 1);
+	test_assert(film_converged(&film, 0, 0));
+	test_assert(!film_converged(&film, 1, 0));
+
+	// A looser threshold lets the noisy one go too
+	test_assert(film_update_convergence(&film, 100.0f) == 0);
+	test_assert(film_converged(&film, 1, 0));
+	film_free(&film);
+	return true;
+}
+
+// Samples that converged pixels don't take go to the noisy ones, within what the whole tile would take
+bool film_redistribution(void) {
+	const size_t sample_count = 16;
+	struct film film = { 0 };
+	film_reset(&film, 8, 8);
+	const size_t pixels = (size_t)film.width * film.height;
+	size_t budget = pixels * sample_count;
+	size_t active = pixels;
+	size_t batch;
+	while ((batch = film_next_batch(budget, active, 4))) {
+		for (unsigned y = 0; y < film.height; ++y) {
+			for (unsigned x = 0; x < film.width; ++x) {
+				if (film_converged(&film, x, y)) continue;
+				for (size_t b = 0; b < batch; ++b) {
+					// A flat tile, but for one pixel
+					const float noisy = (film_count(&film, x, y) % 4) == 1 ? 4.0f : 0.0f;
+					const float value = x == 3 && y == 5 ? noisy : 0.5f;
+					film_add(&film, x, y, (struct color){ value, value, value, 1.0f });
+				}
+			}
+		}
+		budget -= active * batch;
+		if (film_count(&film, 3, 5) >= 8)
+			active = film_update_convergence(&film, 0.01f);
+	}
+	test_assert(!film_converged(&film, 3, 5));
+	test_assert(film_count(&film, 3, 5) > sample_count);
+	size_t taken = 0;
+	for (unsigned y = 0; y < film.height; ++y) {
+		for (unsigned x = 0; x < film.width; ++x)
+			taken += film_count(&film, x, y);
+	}
+	test_assert(taken == pixels * sample_count);
+	film_free(&film);
+	return true;
+}
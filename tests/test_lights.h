@@ -0,0 +1,191 @@
+//
+//  test_lights.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/renderer/lights.h"
+#include "../src/lib/datatypes/scene.h"
+#include "../src/lib/datatypes/poly.h"
+#include "../src/lib/accelerators/bvh.h"
+#include "../src/lib/nodes/bsdfnode.h"
+#include "test_scene.h"
+
+// Only the emissive polygons and spheres make it to the list, transformed to world space
+bool lights_list(void) {
+	struct node_storage *s = make_storage();
+	const struct bsdfNode *emission = newEmission(s, newConstantTexture(s, g_white_color), NULL);
+	const struct bsdfNode *diffuse = newDiffuse(s, newConstantTexture(s, g_white_color));
+	const struct bsdfNode *alpha = newMix(s, newTransparent(s, NULL), emission, NULL);
+	struct world scene = { 0 };
+	const struct bsdfNode *buffers[][2] = { { emission, diffuse }, { diffuse, diffuse }, { alpha, alpha } };
+	for (size_t i = 0; i < 3; ++i) {
+		struct bsdf_buffer bbuf = { 0 };
+		bsdf_node_ptr_arr_add(&bbuf.bsdfs, buffers[i][0]);
+		bsdf_node_ptr_arr_add(&bbuf.bsdfs, buffers[i][1]);
+		bsdf_buffer_arr_add(&scene.shader_buffers, bbuf);
+	}
+
+	// A 2x1 quad, emissive on one half
+	vertex_buffer_arr_add(&scene.v_buffers, (struct vertex_buffer){ 0 });
+	struct vertex_buffer *vbuf = &scene.v_buffers.items[0];
+	vector_arr_add(&vbuf->vertices, (struct vector){ 0.0f, 0.0f, 0.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ 2.0f, 0.0f, 0.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ 2.0f, 0.0f, 1.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ 0.0f, 0.0f, 1.0f });
+	struct mesh mesh = { .vbuf = vbuf };
+	poly_arr_add(&mesh.polygons, (struct poly){ .vertexIndex = { 0, 1, 2 }, .textureIndex = { -1, -1, -1 }, .materialIndex = 0 });
+	poly_arr_add(&mesh.polygons, (struct poly){ .vertexIndex = { 0, 2, 3 }, .textureIndex = { -1, -1, -1 }, .materialIndex = 1 });
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	mesh_arr_add(&scene.meshes, mesh);
+	sphere_arr_add(&scene.spheres, (struct sphere){ .radius = 0.5f });
+
+	struct instance plain = new_mesh_instance(&scene.meshes, 0, NULL, NULL);
+	plain.bbuf_idx = 0;
+	instance_arr_add(&scene.instances, plain);
+	struct instance scaled = new_mesh_instance(&scene.meshes, 0, NULL, NULL);
+	scaled.bbuf_idx = 0;
+	const struct matrix4x4 scale = mat_mul(tform_new_translate(0.0f, 5.0f, 0.0f).A, tform_new_scale(2.0f).A);
+	instance_set_transform(&scaled, (struct transform){ .A = scale, .Ainv = mat_invert(scale) });
+	instance_arr_add(&scene.instances, scaled);
+	struct instance dull = new_mesh_instance(&scene.meshes, 0, NULL, NULL);
+	dull.bbuf_idx = 1;
+	instance_arr_add(&scene.instances, dull);
+	struct instance sphere = new_sphere_instance(&scene.spheres, 0, NULL, NULL);
+	sphere.bbuf_idx = 2;
+	instance_set_transform(&sphere, tform_new_translate(0.0f, -5.0f, 0.0f));
+	instance_arr_add(&scene.instances, sphere);
+	for (size_t i = 0; i < scene.instances.count; ++i)
+		scene.instances.items[i].bbuf = &scene.shader_buffers.items[scene.instances.items[i].bbuf_idx];
+
+	test_assert(light_list_build(&scene.lights, &scene));
+	test_assert(scene.lights.lights.count == 3);
+	very_roughly_equals(scene.lights.total_area, 1.0f + 4.0f + PI);
+	test_assert(scene.instances.items[0].emits_light);
+	test_assert(scene.instances.items[1].emits_light);
+	test_assert(!scene.instances.items[2].emits_light);
+	test_assert(scene.instances.items[3].emits_light);
+	// Nothing changed since
+	test_assert(!light_list_build(&scene.lights, &scene));
+
+	// Sampled points land on the emissive half of the scaled quad
+	for (int i = 0; i < 64; ++i) {
+		struct hitRecord point = { 0 };
+		instance_sample_surface(&scene.instances.items[1], 0, (struct coord){ (i % 8) / 8.0f, (i / 8) / 8.0f }, &point);
+		test_assert(point.bsdf == emission);
+		very_roughly_equals(point.hitPoint.y, 5.0f);
+		test_assert(point.hitPoint.x >= -1e-4f && point.hitPoint.x <= 4.0f + 1e-4f);
+		test_assert(point.hitPoint.z >= -1e-4f && point.hitPoint.z <= point.hitPoint.x * 0.5f + 1e-4f);
+		const struct vector normal = instance_geometric_normal(&scene.instances.items[1], &point);
+		very_roughly_equals(fabsf(normal.y), 1.0f);
+	}
+
+	test_scene_free(&scene);
+	delete_storage(s);
+	return true;
+}
+
+// Rotations keep spheres round, so rotated emissive spheres and sphere sets are still lights. Squashed ones aren't.
+bool lights_rotated_sphere(void) {
+	struct node_storage *s = make_storage();
+	const struct bsdfNode *emission = newEmission(s, newConstantTexture(s, g_white_color), NULL);
+	struct world scene = { 0 };
+	struct bsdf_buffer bbuf = { 0 };
+	bsdf_node_ptr_arr_add(&bbuf.bsdfs, emission);
+	bsdf_buffer_arr_add(&scene.shader_buffers, bbuf);
+	sphere_arr_add(&scene.spheres, (struct sphere){ .radius = 0.5f });
+	sphere_set_arr_add(&scene.sphere_sets, (struct sphere_set){ 0 });
+	struct sphere_set *set = &scene.sphere_sets.items[0];
+	vector_arr_add(&set->centers, (struct vector){ 1.0f, 0.0f, 0.0f });
+	float_arr_add(&set->radii, 0.25f);
+	vector_arr_add(&set->centers, (struct vector){ 0.0f, 0.0f, 2.0f });
+	float_arr_add(&set->radii, 0.5f);
+	set->bvh = build_sphere_set_bvh(set, bvh_layout_float, bvh_builder_sah, NULL);
+
+	const struct matrix4x4 rotated = mat_mul(mat_mul(tform_new_translate(0.0f, 3.0f, 0.0f).A, tform_new_rot(0.3f, 0.7f, 1.1f).A), tform_new_scale(2.0f).A);
+	struct instance sphere = new_sphere_instance(&scene.spheres, 0, NULL, NULL);
+	instance_set_transform(&sphere, (struct transform){ .A = rotated, .Ainv = mat_invert(rotated) });
+	test_assert(sphere.tform_class == tform_class_generic);
+	instance_arr_add(&scene.instances, sphere);
+	struct instance spheres = new_sphere_set_instance(&scene.sphere_sets, 0);
+	instance_set_transform(&spheres, (struct transform){ .A = rotated, .Ainv = mat_invert(rotated) });
+	instance_arr_add(&scene.instances, spheres);
+	struct instance squashed = new_sphere_instance(&scene.spheres, 0, NULL, NULL);
+	instance_set_transform(&squashed, tform_new_scale3(1.0f, 2.0f, 1.0f));
+	instance_arr_add(&scene.instances, squashed);
+	for (size_t i = 0; i < scene.instances.count; ++i)
+		scene.instances.items[i].bbuf = &scene.shader_buffers.items[0];
+
+	test_assert(light_list_build(&scene.lights, &scene));
+	test_assert(scene.lights.lights.count == 3);
+	very_roughly_equals(scene.lights.total_area, 4.0f * PI * (1.0f + 0.25f + 1.0f));
+	test_assert(scene.instances.items[0].emits_light);
+	test_assert(scene.instances.items[1].emits_light);
+	test_assert(!scene.instances.items[2].emits_light);
+
+	// Sampled points land on the transformed spheres, with normals pointing away from their centers
+	const struct vector centers[] = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 2.0f } };
+	const float radii[] = { 1.0f, 0.5f, 1.0f };
+	for (size_t l = 0; l < scene.lights.lights.count; ++l) {
+		const struct light *light = &scene.lights.lights.items[l];
+		const struct instance *instance = &scene.instances.items[light->instance];
+		struct vector center = centers[light->instance ? light->prim + 1 : 0];
+		tform_point(&center, rotated);
+		for (int i = 0; i < 64; ++i) {
+			struct hitRecord point = { 0 };
+			instance_sample_surface(instance, light->prim, (struct coord){ (i % 8) / 8.0f, (i / 8) / 8.0f }, &point);
+			test_assert(point.bsdf == emission);
+			const struct vector offset = vec_sub(point.hitPoint, center);
+			very_roughly_equals(vec_length(offset), radii[light->instance ? light->prim + 1 : 0]);
+			very_roughly_equals(vec_dot(vec_normalize(offset), instance_geometric_normal(instance, &point)), 1.0f);
+		}
+	}
+
+	test_scene_free(&scene);
+	delete_storage(s);
+	return true;
+}
+
+// A diffuse point under a small spherical light gets albedo * L * (r / d)^2 reflected
+bool lights_direct(void) {
+	struct node_storage *s = make_storage();
+	const struct bsdfNode *emission = newEmission(s, newConstantTexture(s, g_white_color), newConstantValue(s, 2.0f));
+	const struct bsdfNode *diffuse = newDiffuse(s, newConstantTexture(s, (struct color){ 0.5f, 0.5f, 0.5f, 1.0f }));
+	struct world scene = { 0 };
+	struct bsdf_buffer bbuf = { 0 };
+	bsdf_node_ptr_arr_add(&bbuf.bsdfs, emission);
+	bsdf_buffer_arr_add(&scene.shader_buffers, bbuf);
+	sphere_arr_add(&scene.spheres, (struct sphere){ .radius = 0.1f });
+	struct instance light = new_sphere_instance(&scene.spheres, 0, NULL, NULL);
+	instance_set_transform(&light, tform_new_translate(0.0f, 10.0f, 0.0f));
+	light.bbuf = &scene.shader_buffers.items[0];
+	instance_arr_add(&scene.instances, light);
+	test_assert(light_list_build(&scene.lights, &scene));
+	scene.topLevel = build_top_level_bvh(scene.instances, bvh_builder_sah, NULL);
+
+	struct lightRay incident = { .start = { 0.0f, 1.0f, -1.0f }, .direction = vec_normalize((struct vector){ 0.0f, -1.0f, 1.0f }) };
+	const struct hitRecord isect = {
+		.incident = &incident,
+		.surfaceNormal = { 0.0f, 1.0f, 0.0f },
+		.bsdf = diffuse,
+		.instIndex = -1
+	};
+	sampler *sampler = newSampler();
+	const int samples = 4096;
+	float sum = 0.0f;
+	for (int i = 0; i < samples; ++i) {
+		initSampler(sampler, Halton, i, samples, 1);
+		sum += light_sample_direct(&scene, &isect, sampler).red;
+	}
+	const float expected = 0.5f * 2.0f * (0.1f * 0.1f) / (10.0f * 10.0f);
+	test_assert(fabsf(sum / samples - expected) < 0.02f * expected);
+
+	destroySampler(sampler);
+	test_scene_free(&scene);
+	delete_storage(s);
+	return true;
+}
@@ -4,12 +4,12 @@
 
 #pragma once
 
-#include "../src/renderer/samplers/sampler.h"
+#include "../src/lib/renderer/samplers/sampler.h"
 
 bool test_halton(void) {
 	struct sampler *sampler = newSampler();
 	initSampler(sampler, Halton, 0, 1, 0);
-
+	destroySampler(sampler);
 	return true;
 }
 
@@ -39,4 +39,66 @@ bool test_pseudorandom(void) {
 		test_assert(first_run[i] == second_run[i]);
 	}
 	return true;
-}
\ No newline at end of file
+}
+
+// Every 16 samples of a pixel put one value in each 1/16th of a dimension,
+// and one pair in each cell of a 4x4 grid for dimensions of the same group
+bool test_sobol_stratified(void) {
+	struct sampler *sampler = newSampler();
+	bool bins[3][16] = { 0 };
+	bool cells[16] = { 0 };
+	for (int pass = 0; pass < 16; ++pass) {
+		initSampler(sampler, Sobol, pass, 16, 1234);
+		const float x = getDimension(sampler);
+		const float y = getDimension(sampler);
+		samplerSetBounce(sampler, 2);
+		const float z = getDimension(sampler);
+		const float dims[3] = { x, y, z };
+		for (size_t d = 0; d < 3; ++d) {
+			test_assert(dims[d] >= 0.0f && dims[d] < 1.0f);
+			const size_t bin = (size_t)(dims[d] * 16.0f);
+			test_assert(!bins[d][bin]);
+			bins[d][bin] = true;
+		}
+		const size_t cell = (size_t)(x * 4.0f) * 4 + (size_t)(y * 4.0f);
+		test_assert(!cells[cell]);
+		cells[cell] = true;
+	}
+	destroySampler(sampler);
+	return true;
+}
+
+// A bounce gets the same dimensions, however many the bounces before it used
+bool test_sobol_bounce(void) {
+	struct sampler *sampler = newSampler();
+	initSampler(sampler, Sobol, 5, 16, 42);
+	getDimension(sampler);
+	samplerSetBounce(sampler, 3);
+	const float first = getDimension(sampler);
+	initSampler(sampler, Sobol, 5, 16, 42);
+	for (size_t i = 0; i < 7; ++i)
+		getDimension(sampler);
+	samplerSetBounce(sampler, 3);
+	test_assert(getDimension(sampler) == first);
+	destroySampler(sampler);
+	return true;
+}
+
+// Filling dimensions in bulk gives the same values as drawing them one by one
+bool test_sampler_bulk(void) {
+	struct sampler *sampler = newSampler();
+	for (int type = Halton; type <= Sobol; ++type) {
+		float one_by_one[12];
+		initSampler(sampler, type, 3, 16, 99);
+		for (size_t i = 0; i < 12; ++i)
+			one_by_one[i] = getDimension(sampler);
+		float bulk[12];
+		initSampler(sampler, type, 3, 16, 99);
+		bulk[0] = getDimension(sampler);
+		getDimensions(sampler, bulk + 1, 11);
+		for (size_t i = 0; i < 12; ++i)
+			test_assert(bulk[i] == one_by_one[i]);
+	}
+	destroySampler(sampler);
+	return true;
+}
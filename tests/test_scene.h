@@ -0,0 +1,32 @@
+//
+//  test_scene.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/renderer/lights.h"
+#include "../src/lib/datatypes/scene.h"
+#include "../src/lib/datatypes/mesh.h"
+#include "../src/lib/datatypes/sphere.h"
+#include "../src/lib/accelerators/bvh.h"
+#include "../src/lib/nodes/bsdfnode.h"
+
+// Frees what tests put in a scene they build by hand on the stack. scene_destroy() expects a loaded one.
+static void test_scene_free(struct world *scene) {
+	destroy_bvh(scene->topLevel);
+	light_list_free(&scene->lights);
+	scene->meshes.elem_free = mesh_free;
+	mesh_arr_free(&scene->meshes);
+	scene->v_buffers.elem_free = vertex_buf_free;
+	vertex_buffer_arr_free(&scene->v_buffers);
+	scene->shader_buffers.elem_free = bsdf_buffer_free;
+	bsdf_buffer_arr_free(&scene->shader_buffers);
+	instance_arr_free(&scene->instances);
+	sphere_arr_free(&scene->spheres);
+	scene->sphere_sets.elem_free = sphere_set_free;
+	sphere_set_arr_free(&scene->sphere_sets);
+}
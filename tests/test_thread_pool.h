@@ -7,6 +7,7 @@
 //
 
 #include "../src/common/platform/thread_pool.h"
+#include "../src/common/platform/atomic.h"
 #include "../src/common/timer.h"
 #include <pthread.h>
 #include <stdio.h>
@@ -47,3 +48,91 @@ bool test_thread_pool(void) {
 
 	return true;
 }
+
+struct group_test_arg {
+	struct cr_thread_pool *pool;
+	int *values;
+	size_t count;
+};
+
+void test_group_leaf(void *arg) {
+	int *value = arg;
+	*value += 1;
+}
+
+// Splits its range in halves on the same pool, waiting on its own group like a recursive build would
+void test_group_task(void *arg) {
+	struct group_test_arg *input = arg;
+	if (input->count < 4) {
+		for (size_t i = 0; i < input->count; ++i)
+			test_group_leaf(&input->values[i]);
+		return;
+	}
+	struct cr_task_group group = { 0 };
+	struct group_test_arg halves[2] = {
+		{ input->pool, input->values, input->count / 2 },
+		{ input->pool, input->values + input->count / 2, input->count - input->count / 2 },
+	};
+	thread_pool_enqueue_group(input->pool, &group, test_group_task, &halves[0]);
+	thread_pool_enqueue_group(input->pool, &group, test_group_task, &halves[1]);
+	thread_pool_wait_group(input->pool, &group);
+}
+
+bool test_thread_pool_group(void) {
+	const size_t count = 1000;
+	struct cr_thread_pool *pool = thread_pool_create(4);
+	int *values = calloc(count, sizeof(*values));
+
+	struct cr_task_group group = { 0 };
+	struct group_test_arg root = { pool, values, count };
+	thread_pool_enqueue_group(pool, &group, test_group_task, &root);
+	thread_pool_wait_group(pool, &group);
+	test_assert(group.pending == 0);
+	for (size_t i = 0; i < count; ++i) {
+		test_assert(values[i] == 1);
+	}
+
+	thread_pool_destroy(pool);
+	free(values);
+	return true;
+}
+
+struct reserve_test_arg {
+	size_t *started;
+	size_t expected;
+	bool all_met;
+};
+
+// Waits for every other task to start too, which only works if each one has a thread of its own
+void test_reserve_task(void *arg) {
+	struct reserve_test_arg *input = arg;
+	cr_atomic_add(input->started, 1);
+	for (int i = 0; i < 1000 && cr_atomic_load(input->started) < input->expected; ++i)
+		timer_sleep_ms(1);
+	input->all_met = cr_atomic_load(input->started) == input->expected;
+}
+
+bool test_thread_pool_reserve(void) {
+	const size_t count = 6;
+	struct cr_thread_pool *pool = thread_pool_create(2);
+	thread_pool_reserve(pool, count);
+	// Shrinking isn't a thing
+	thread_pool_reserve(pool, 1);
+
+	size_t started = 0;
+	struct reserve_test_arg args[6];
+	struct cr_task_group group = { 0 };
+	for (size_t i = 0; i < count; ++i) {
+		args[i] = (struct reserve_test_arg){ &started, count, false };
+		thread_pool_enqueue_group(pool, &group, test_reserve_task, &args[i]);
+	}
+	// Don't help out, the pool has to manage on its own
+	while (cr_atomic_load(&started) < count)
+		timer_sleep_ms(1);
+	thread_pool_wait_group(pool, &group);
+	for (size_t i = 0; i < count; ++i)
+		test_assert(args[i].all_met);
+
+	thread_pool_destroy(pool);
+	return true;
+}
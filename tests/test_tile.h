@@ -0,0 +1,175 @@
+//
+//  test_tile.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/datatypes/tile.h"
+#include "../src/lib/renderer/renderer.h"
+#include "../src/common/platform/thread.h"
+#include "../src/common/platform/atomic.h"
+#include "../src/common/timer.h"
+
+#define TILE_TEST_THREADS 8
+
+// Every pixel has to be covered by exactly one tile, also after the last tiles were split
+bool tile_quantize_split(void) {
+	const unsigned width = 333, height = 129;
+	const size_t thread_counts[] = { 0, 3, 8, 1000 };
+	for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t) {
+		struct tile_set set = tile_quantize(width, height, 32, 32, ro_from_middle, thread_counts[t]);
+		test_assert(set.tiles.count >= 11 * 5);
+		unsigned char *covered = calloc(width * height, 1);
+		for (size_t i = 0; i < set.tiles.count; ++i) {
+			const struct render_tile *tile = &set.tiles.items[i];
+			test_assert(tile->width == (unsigned)(tile->end.x - tile->begin.x));
+			test_assert(tile->height == (unsigned)(tile->end.y - tile->begin.y));
+			for (int y = tile->begin.y; y < tile->end.y; ++y)
+				for (int x = tile->begin.x; x < tile->end.x; ++x)
+					covered[y * width + x]++;
+		}
+		for (size_t i = 0; i < width * height; ++i)
+			test_assert(covered[i] == 1);
+		free(covered);
+		tile_set_free(&set);
+	}
+	return true;
+}
+
+struct tile_test_thread {
+	struct renderer *r;
+	struct tile_set *set;
+	size_t *passes; // Per tile
+	bool out_of_order;
+};
+
+static void *tile_test_claim(void *arg) {
+	struct tile_test_thread *t = arg;
+	struct render_tile *tile;
+	while ((tile = tile_next(t->set)))
+		cr_atomic_add(&t->passes[tile->index], 1);
+	return NULL;
+}
+
+static void *tile_test_claim_interactive(void *arg) {
+	struct tile_test_thread *t = arg;
+	struct render_tile *tile;
+	size_t pass = 0;
+	size_t generation = 0;
+	while ((tile = tile_next_interactive(t->r, t->set, &pass, &generation))) {
+		// Nobody else may be working on this tile now
+		if (cr_atomic_add(&t->passes[tile->index], 1) != pass - 1)
+			t->out_of_order = true;
+		tile_finish_interactive(t->r, t->set, tile, pass, generation);
+	}
+	return NULL;
+}
+
+// Threads grabbing tiles at the same time must get each tile exactly once
+bool tile_next_concurrent(void) {
+	struct tile_set set = tile_quantize(640, 480, 16, 16, ro_normal, TILE_TEST_THREADS);
+	struct tile_test_thread state = { .set = &set, .passes = calloc(set.tiles.count, sizeof(size_t)) };
+	struct cr_thread threads[TILE_TEST_THREADS];
+	for (size_t i = 0; i < TILE_TEST_THREADS; ++i) {
+		threads[i] = (struct cr_thread){ .thread_fn = tile_test_claim, .user_data = &state };
+		test_assert(!thread_start(&threads[i]));
+	}
+	for (size_t i = 0; i < TILE_TEST_THREADS; ++i)
+		thread_wait(&threads[i]);
+	for (size_t i = 0; i < set.tiles.count; ++i)
+		test_assert(state.passes[i] == 1);
+	free(state.passes);
+	tile_set_free(&set);
+	return true;
+}
+
+// More threads than tiles, so that tiles come up again while their previous pass is still rendering
+bool tile_next_interactive_passes(void) {
+	struct renderer r = { 0 };
+	r.prefs.sampleCount = 50;
+	r.state.finishedPasses = 1;
+	r.state.rendering = true;
+	worker_arr_add(&r.state.workers, (struct worker){ 0 });
+	struct tile_set set = tile_quantize(8, 8, 4, 4, ro_normal, 0);
+	for (size_t i = 0; i < set.tiles.count; ++i)
+		set.tiles.items[i].total_samples = r.prefs.sampleCount;
+	struct tile_test_thread state = { .r = &r, .set = &set, .passes = calloc(set.tiles.count, sizeof(size_t)) };
+	struct cr_thread threads[TILE_TEST_THREADS];
+	for (size_t i = 0; i < TILE_TEST_THREADS; ++i) {
+		threads[i] = (struct cr_thread){ .thread_fn = tile_test_claim_interactive, .user_data = &state };
+		test_assert(!thread_start(&threads[i]));
+	}
+	// Once done, the threads wait for a restart until the render stops
+	while (cr_atomic_load(&r.state.finishedPasses) < r.prefs.sampleCount + 1)
+		timer_sleep_ms(1);
+	r.state.rendering = false;
+	tile_set_wake(&set);
+	for (size_t i = 0; i < TILE_TEST_THREADS; ++i)
+		thread_wait(&threads[i]);
+	test_assert(!state.out_of_order);
+	for (size_t i = 0; i < set.tiles.count; ++i)
+		test_assert(state.passes[i] == r.prefs.sampleCount);
+	free(state.passes);
+	worker_arr_free(&r.state.workers);
+	tile_set_free(&set);
+	return true;
+}
+
+struct tile_test_waiter {
+	struct renderer *r;
+	struct tile_set *set;
+	struct render_tile *tile;
+	size_t pass;
+	size_t generation;
+};
+
+static void *tile_test_claim_once(void *arg) {
+	struct tile_test_waiter *w = arg;
+	w->tile = tile_next_interactive(w->r, w->set, &w->pass, &w->generation);
+	return NULL;
+}
+
+// A thread waiting for the previous pass of its tile must give up its claim if the render gets restarted
+bool tile_next_interactive_restart(void) {
+	struct renderer r = { 0 };
+	r.prefs.sampleCount = 4;
+	r.state.finishedPasses = 1;
+	r.state.rendering = true;
+	worker_arr_add(&r.state.workers, (struct worker){ 0 });
+	struct tile_set set = tile_quantize(4, 4, 4, 4, ro_normal, 0);
+	test_assert(set.tiles.count == 1);
+	size_t pass = 0;
+	size_t generation = 0;
+	struct render_tile *tile = tile_next_interactive(&r, &set, &pass, &generation);
+	test_assert(tile && pass == 1);
+
+	// The second pass of the only tile has to wait for the first one
+	struct tile_test_waiter waiter = { .r = &r, .set = &set };
+	struct cr_thread thread = { .thread_fn = tile_test_claim_once, .user_data = &waiter };
+	test_assert(!thread_start(&thread));
+	while (!cr_atomic_load(&set.waiting))
+		timer_sleep_ms(1);
+	r.state.finishedPasses = 3;
+	tile_set_restart(&r, &set);
+	test_assert(r.state.finishedPasses == 1);
+	thread_wait(&thread);
+	test_assert(waiter.tile == tile);
+	test_assert(waiter.pass == 1);
+	test_assert(waiter.generation != generation);
+
+	// The first pass from before the restart doesn't count, the one after does
+	tile_finish_interactive(&r, &set, tile, pass, generation);
+	test_assert(tile->completed_samples == 0);
+	test_assert(r.state.finishedPasses == 1);
+	tile_finish_interactive(&r, &set, waiter.tile, waiter.pass, waiter.generation);
+	test_assert(tile->completed_samples == 1);
+	test_assert(r.state.finishedPasses == 2);
+
+	worker_arr_free(&r.state.workers);
+	tile_set_free(&set);
+	return true;
+}
@@ -247,6 +247,19 @@ bool transform_inverse() {
 	return true;
 }
 
+bool transform_classify() {
+	test_assert(tform_classify(tform_new().A) == tform_class_identity);
+	test_assert(tform_classify(tform_new_translate(1.0f, -2.0f, 3.0f).A) == tform_class_translate);
+	test_assert(tform_classify(tform_new_scale(2.0f).A) == tform_class_translate_scale);
+	struct transform scaled = tform_new_translate(1.0f, 2.0f, 3.0f);
+	scaled.A = mat_mul(scaled.A, tform_new_scale(0.5f).A);
+	test_assert(tform_classify(scaled.A) == tform_class_translate_scale);
+	test_assert(tform_classify(tform_new_scale(-1.0f).A) == tform_class_generic);
+	test_assert(tform_classify(tform_new_scale3(1.0f, 2.0f, 1.0f).A) == tform_class_generic);
+	test_assert(tform_classify(tform_new_rot_y(0.5f).A) == tform_class_generic);
+	return true;
+}
+
 bool matrix_equal() {
 	
 	struct matrix4x4 A = (struct matrix4x4){
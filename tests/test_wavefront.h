@@ -0,0 +1,96 @@
+//
+//  test_wavefront.h
+//  c-ray
+//
+//  Created by Valtteri on 17.10.2026.
+//  Copyright © 2026 Valtteri Koskivuori. All rights reserved.
+//
+
+#pragma once
+
+#include "../src/lib/renderer/wavefront.h"
+#include "../src/lib/renderer/pathtrace.h"
+#include "../src/lib/renderer/lights.h"
+#include "../src/lib/datatypes/scene.h"
+#include "../src/lib/datatypes/poly.h"
+#include "../src/lib/accelerators/bvh.h"
+#include "../src/lib/nodes/bsdfnode.h"
+#include "test_scene.h"
+#include "../src/lib/nodes/shaders/background.h"
+
+#define WAVEFRONT_TEST_RAYS 512
+
+// A wave shades paths in a different order, but each path has to come out exactly like path_trace() traces it
+bool wavefront_matches_path_trace(void) {
+	struct node_storage *s = make_storage();
+	const struct colorNode *white = newConstantTexture(s, g_white_color);
+	const struct colorNode *grey = newConstantTexture(s, (struct color){ 0.6f, 0.6f, 0.6f, 1.0f });
+	const struct bsdfNode *shaders[] = {
+		newDiffuse(s, grey),
+		newEmission(s, white, newConstantValue(s, 4.0f)),
+		newGlass(s, white, NULL, newConstantValue(s, 1.5f)),
+		newMetal(s, grey, newConstantValue(s, 0.3f)),
+		newPlastic(s, grey, newConstantValue(s, 0.2f), NULL),
+	};
+	struct world scene = { 0 };
+	scene.background = newBackground(s, newConstantTexture(s, (struct color){ 0.2f, 0.3f, 0.5f, 1.0f }), NULL, NULL, false);
+	for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); ++i) {
+		struct bsdf_buffer bbuf = { 0 };
+		bsdf_node_ptr_arr_add(&bbuf.bsdfs, shaders[i]);
+		bsdf_buffer_arr_add(&scene.shader_buffers, bbuf);
+	}
+
+	// A diffuse floor, with a light and three spheres of the other shaders over it
+	vertex_buffer_arr_add(&scene.v_buffers, (struct vertex_buffer){ 0 });
+	struct vertex_buffer *vbuf = &scene.v_buffers.items[0];
+	vector_arr_add(&vbuf->vertices, (struct vector){ -10.0f, 0.0f, -10.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ 10.0f, 0.0f, -10.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ 10.0f, 0.0f, 10.0f });
+	vector_arr_add(&vbuf->vertices, (struct vector){ -10.0f, 0.0f, 10.0f });
+	struct mesh mesh = { .vbuf = vbuf };
+	poly_arr_add(&mesh.polygons, (struct poly){ .vertexIndex = { 0, 2, 1 }, .normalIndex = { -1, -1, -1 }, .textureIndex = { -1, -1, -1 } });
+	poly_arr_add(&mesh.polygons, (struct poly){ .vertexIndex = { 0, 3, 2 }, .normalIndex = { -1, -1, -1 }, .textureIndex = { -1, -1, -1 } });
+	mesh.bvh = build_mesh_bvh(&mesh, bvh_layout_float, bvh_builder_sah, NULL);
+	mesh_arr_add(&scene.meshes, mesh);
+	struct instance floor = new_mesh_instance(&scene.meshes, 0, NULL, NULL);
+	floor.bbuf_idx = 0;
+	instance_arr_add(&scene.instances, floor);
+	const struct vector centers[] = { { 0.0f, 4.0f, 0.0f }, { -2.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 1.0f }, { 2.0f, 1.0f, 0.0f } };
+	for (size_t i = 0; i < 4; ++i) {
+		sphere_arr_add(&scene.spheres, (struct sphere){ .radius = i ? 1.0f : 0.5f });
+		struct instance sphere = new_sphere_instance(&scene.spheres, i, NULL, NULL);
+		sphere.bbuf_idx = i + 1;
+		instance_set_transform(&sphere, tform_new_translate(centers[i].x, centers[i].y, centers[i].z));
+		instance_arr_add(&scene.instances, sphere);
+	}
+	for (size_t i = 0; i < scene.instances.count; ++i)
+		scene.instances.items[i].bbuf = &scene.shader_buffers.items[scene.instances.items[i].bbuf_idx];
+	test_assert(light_list_build(&scene.lights, &scene));
+	scene.topLevel = build_top_level_bvh(scene.instances, bvh_builder_sah, NULL);
+
+	// Rays fanning out from a camera in front of the spheres
+	struct wavefront *wave = wavefront_new();
+	sampler *sampler = newSampler();
+	for (size_t i = 0; i < WAVEFRONT_TEST_RAYS; ++i) {
+		const float u = (float)(i % 32) / 32.0f - 0.5f;
+		const float v = (float)(i / 32) / (WAVEFRONT_TEST_RAYS / 32) - 0.5f;
+		wave->incident[i] = (struct lightRay){
+			.start = { 0.0f, 2.0f, -6.0f },
+			.direction = vec_normalize((struct vector){ u, v - 0.2f, 1.0f }),
+			.type = rt_camera
+		};
+		initSampler(wave->samplers[i], Halton, 3, 16, (uint32_t)i);
+	}
+	wavefront_trace(wave, WAVEFRONT_TEST_RAYS, &scene, 8);
+	for (size_t i = 0; i < WAVEFRONT_TEST_RAYS; ++i) {
+		initSampler(sampler, Halton, 3, 16, (uint32_t)i);
+		const struct color expected = path_trace(wave->incident[i], &scene, 8, sampler);
+		test_assert(memcmp(&wave->radiance[i], &expected, sizeof(expected)) == 0);
+	}
+
+	destroySampler(sampler);
+	wavefront_destroy(wave);
+	test_scene_free(&scene);
+	delete_storage(s);
+	return true;
+}
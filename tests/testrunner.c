@@ -103,7 +103,7 @@ int runPerfTest(unsigned t, char *suite) {
 	time_t usecs = 0;
 	
 	for (size_t i = 0; i < PERF_AVG_COUNT; ++i) {
-		usecs += perf_tests[t].func();
+		usecs += perf_tests[first_idx + t].func();
 	}
 	
 	usecs = usecs / PERF_AVG_COUNT;
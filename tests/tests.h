@@ -51,6 +51,14 @@ static char *failed_expression;
 #include "test_dyn_array.h"
 #include "test_serializer.h"
 #include "test_thread_pool.h"
+#include "test_capabilities.h"
+#include "test_tile.h"
+#include "test_film.h"
+#include "test_sampler.h"
+#include "test_bvh.h"
+#include "test_lights.h"
+#include "test_bsdf.h"
+#include "test_wavefront.h"
 
 typedef struct {
 	char *test_name;
@@ -94,6 +102,7 @@ static test tests[] = {
 	{"transforms::scaleAll", transform_scale_all},
 	{"transforms::inverse", transform_inverse},
 	{"transforms::equal", matrix_equal},
+	{"transforms::classify", transform_classify},
 	
 	{"textbuffer::textview", textbuffer_textview},
 	{"textbuffer::tokenizer", textbuffer_tokenizer},
@@ -189,6 +198,47 @@ static test tests[] = {
 	{"serializer::serialize", serializer_serialize},
 
 	{"threadpool::basic", test_thread_pool},
+	{"threadpool::group", test_thread_pool_group},
+	{"threadpool::reserve", test_thread_pool_reserve},
+	{"capabilities::topology_order", capabilities_topology_order},
+
+	{"tile::quantize_split", tile_quantize_split},
+	{"tile::next_concurrent", tile_next_concurrent},
+	{"tile::next_interactive_passes", tile_next_interactive_passes},
+	{"tile::next_interactive_restart", tile_next_interactive_restart},
+
+	{"film::average", film_average},
+	{"film::convergence", film_convergence},
+	{"film::redistribution", film_redistribution},
+
+	{"sampler::halton", test_halton},
+	{"sampler::pseudorandom", test_pseudorandom},
+	{"sampler::sobol_stratified", test_sobol_stratified},
+	{"sampler::sobol_bounce", test_sobol_bounce},
+	{"sampler::bulk", test_sampler_bulk},
+
+	{"bvh::traversal", bvh_traversal},
+	{"bvh::parallel_build", bvh_parallel_build},
+	{"bvh::spatial_splits", bvh_spatial_splits},
+	{"bvh::fast_builder", bvh_fast_builder},
+	{"bvh::quantized", bvh_quantized},
+	{"bvh::refit", bvh_refit},
+	{"bvh::cache", bvh_cache},
+	{"bvh::occlusion", bvh_occlusion},
+	{"bvh::sphere_set", bvh_sphere_set},
+	{"bvh::sphere_set_instance", bvh_sphere_set_instance},
+	{"bvh::flatten", bvh_flatten},
+	{"bvh::empty", bvh_empty},
+
+	{"lights::list", lights_list},
+	{"lights::direct", lights_direct},
+	{"lights::rotated_sphere", lights_rotated_sphere},
+
+	{"bsdf::agreement", bsdf_agreement},
+	{"bsdf::singular", bsdf_singular},
+	{"bsdf::add_emission", bsdf_add_emission},
+
+	{"wavefront::matches_path_trace", wavefront_matches_path_trace},
 };
 
 #define testCount (sizeof(tests) / sizeof(test))